@@ -0,0 +1,288 @@
+#include "search_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <execution>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Allocation checks of the query and removal paths. They replace the global operator new
+// and delete, so they live in their own executable and leave the timings of
+// search_server_bench alone
+
+// Heap allocations made by the whole program. Every form of
+// the global operator new and delete is replaced, so no allocation bypasses the count
+atomic<size_t> allocation_count = 0;
+
+namespace {
+
+// Out of line, so the compiler never sees free() paired with an inlined operator new
+[[gnu::noinline]] void* CountedAllocate(size_t size, size_t alignment) noexcept {
+    ++allocation_count;
+    size = max<size_t>(size, 1);
+    if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        return malloc(size);
+    }
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+[[gnu::noinline]] void CountedFree(void* pointer) noexcept {
+    free(pointer);
+}
+
+void* CountedAllocateOrThrow(size_t size, size_t alignment) {
+    if (void* const pointer = CountedAllocate(size, alignment)) {
+        return pointer;
+    }
+    throw bad_alloc();
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+    return CountedAllocateOrThrow(size, 0);
+}
+
+void* operator new[](size_t size) {
+    return CountedAllocateOrThrow(size, 0);
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+    return CountedAllocateOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, align_val_t alignment) {
+    return CountedAllocateOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept {
+    return CountedAllocate(size, 0);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept {
+    return CountedAllocate(size, 0);
+}
+
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+    return CountedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+    return CountedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept {
+    CountedFree(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    CountedFree(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    CountedFree(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    CountedFree(pointer);
+}
+
+void operator delete(void* pointer, align_val_t) noexcept {
+    CountedFree(pointer);
+}
+
+void operator delete[](void* pointer, align_val_t) noexcept {
+    CountedFree(pointer);
+}
+
+void operator delete(void* pointer, size_t, align_val_t) noexcept {
+    CountedFree(pointer);
+}
+
+void operator delete[](void* pointer, size_t, align_val_t) noexcept {
+    CountedFree(pointer);
+}
+
+void operator delete(void* pointer, const nothrow_t&) noexcept {
+    CountedFree(pointer);
+}
+
+void operator delete[](void* pointer, const nothrow_t&) noexcept {
+    CountedFree(pointer);
+}
+
+void operator delete(void* pointer, align_val_t, const nothrow_t&) noexcept {
+    CountedFree(pointer);
+}
+
+void operator delete[](void* pointer, align_val_t, const nothrow_t&) noexcept {
+    CountedFree(pointer);
+}
+
+namespace {
+
+string MakeWord(int index) {
+    string word = "w"s;
+    word += to_string(index);
+    return word;
+}
+
+template <typename Function>
+double MeasureMs(Function function, int repeats) {
+    const auto start = chrono::steady_clock::now();
+    for (int i = 0; i < repeats; ++i) {
+        function();
+    }
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / repeats;
+}
+
+bool HaveSameResults(const vector<Document>& lhs, const vector<Document>& rhs) {
+    return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& a, const Document& b) {
+        return a.id == b.id && a.rating == b.rating && abs(a.relevance - b.relevance) < 1e-12;
+    });
+}
+
+// Once the scratch buffers of the thread are sized by a first round of queries, parsing,
+// evaluating and matching the same queries again under execution::seq must not allocate
+bool BenchQueryAllocations() {
+    const int vocabulary_size = 20'000;
+    const int document_count = 50'000;
+    const int words_per_document = 20;
+    mt19937 generator(29);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    SearchServer search_server("and with"s);
+    for (int id = 0; id < document_count; ++id) {
+        string text;
+        for (int i = 0; i < words_per_document; ++i) {
+            text += MakeWord(word_index(generator));
+            text += ' ';
+        }
+        search_server.AddDocument(id, text, static_cast<DocumentStatus>(id % 4), { id % 7 });
+    }
+    vector<string> queries;
+    for (int i = 0; i < 1'000; ++i) {
+        const string word = MakeWord(word_index(generator));
+        queries.push_back(word + " and "s + MakeWord(word_index(generator)) + " "s + word + " -"s + MakeWord(word_index(generator)));
+    }
+
+    vector<Document> documents;
+    vector<string_view> matched_words;
+    const auto run_queries = [&] {
+        for (const string& query : queries) {
+            search_server.FindTopDocuments(execution::seq, query, [](int document_id, DocumentStatus status, int rating) {
+                return status == DocumentStatus::ACTUAL;
+            }, MAX_RESULT_DOCUMENT_COUNT, documents);
+            search_server.MatchDocument(query, documents.empty() ? 0 : documents.front().id, matched_words);
+        }
+    };
+    // the counter must see the array, nothrow and over-aligned forms as well
+    struct alignas(64) OverAligned {
+        char data[64];
+    };
+    const size_t before_forms = allocation_count;
+    delete[] new char[3];
+    delete new (nothrow) int;
+    delete new OverAligned;
+    delete[] new (nothrow) OverAligned[2];
+    const bool counts_every_form = allocation_count - before_forms == 4;
+
+    cout << "evaluation\tallocations_per_query"s << endl;
+    size_t total_allocation_count = 0;
+    for (const auto evaluation : { QueryEvaluation::DYNAMIC_PRUNING, QueryEvaluation::EXHAUSTIVE }) {
+        search_server.SetQueryEvaluation(evaluation);
+        run_queries();
+        const size_t before = allocation_count;
+        run_queries();
+        const size_t query_allocation_count = allocation_count - before;
+        cout << (evaluation == QueryEvaluation::EXHAUSTIVE ? "exhaustive"s : "pruning"s) << '\t'
+            << query_allocation_count * 1.0 / queries.size() << endl;
+        total_allocation_count += query_allocation_count;
+    }
+    cout << "counts_every_form\t"s << counts_every_form << endl;
+    return total_allocation_count == 0 && counts_every_form;
+}
+
+// RemoveDocument only sets the tombstone and the counters: a removal costs the same for
+// long and short documents and allocates nothing once the list of removed documents has
+// grown. Until the purge queries must rank like an index built without the removed documents
+bool BenchRemoveDocument() {
+    const int vocabulary_size = 20'000;
+    const int document_count = 4'000;
+    const int removed_count = 1'000;
+    mt19937 generator(61);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    vector<string> queries(200);
+    for (string& query : queries) {
+        query = MakeWord(word_index(generator) / 20) + " "s + MakeWord(word_index(generator) / 5);
+    }
+
+    size_t mismatch_count = 0;
+    size_t removal_allocation_count = 0;
+    cout << "words_per_document\tus_per_removal\tallocations_per_removal"s << endl;
+    for (const int words_per_document : { 10, 1'000 }) {
+        vector<string> texts(document_count);
+        for (string& text : texts) {
+            for (int i = 0; i < words_per_document; ++i) {
+                text += MakeWord(word_index(generator) / (1 + i % 4));
+                text += ' ';
+            }
+        }
+        SearchServer search_server("and with"s);
+        for (int id = 0; id < document_count; ++id) {
+            search_server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 4 == 3 ? 2 : 0), { id % 7 });
+        }
+        // the first round grows the list of removed documents, the re-adds empty it again
+        for (int id = 0; id < removed_count; ++id) {
+            search_server.RemoveDocument(id);
+        }
+        search_server.FindTopDocuments(queries.front());
+        for (int id = 0; id < removed_count; ++id) {
+            search_server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 4 == 3 ? 2 : 0), { id % 7 });
+        }
+
+        const size_t before = allocation_count;
+        const double ms = MeasureMs([&] {
+            for (int id = removed_count; id < 2 * removed_count; ++id) {
+                search_server.RemoveDocument(id);
+            }
+        }, 1);
+        removal_allocation_count += allocation_count - before;
+        cout << words_per_document << '\t' << ms * 1000.0 / removed_count << '\t'
+            << (allocation_count - before) * 1.0 / removed_count << endl;
+
+        SearchServer rebuilt_server("and with"s);
+        for (int id = 0; id < document_count; ++id) {
+            if (id < removed_count || id >= 2 * removed_count) {
+                rebuilt_server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 4 == 3 ? 2 : 0), { id % 7 });
+            }
+        }
+        for (const string& query : queries) {
+            mismatch_count += !HaveSameResults(search_server.FindTopDocuments(query), rebuilt_server.FindTopDocuments(query));
+        }
+        search_server.PurgeRemovedDocuments();
+        mismatch_count += search_server.GetUnpurgedRemovedCount() != 0;
+        for (const string& query : queries) {
+            mismatch_count += !HaveSameResults(search_server.FindTopDocuments(query, DocumentStatus::BANNED),
+                rebuilt_server.FindTopDocuments(query, DocumentStatus::BANNED));
+        }
+    }
+    cout << "mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0 && removal_allocation_count == 0;
+}
+
+}  // namespace
+
+int main() {
+    const bool allocations_ok = BenchQueryAllocations();
+    const bool removal_ok = BenchRemoveDocument();
+    return allocations_ok && removal_ok ? 0 : 1;
+}
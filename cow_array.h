@@ -0,0 +1,45 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Fixed-size array whose copies share storage. The elements live in blocks: a copy
+// shares every block with the original, and a change copies only the block it
+// touches, unless no other copy holds that block any more. Built for versions that
+// are published to readers: a version must not change once other threads read it.
+template <typename T, size_t BLOCK_SIZE = 1024>
+class CowArray {
+public:
+    CowArray() = default;
+
+    // Value-initialized elements, all blocks share one until they are changed
+    explicit CowArray(size_t size)
+        : size_(size)
+        , blocks_((size + BLOCK_SIZE - 1) / BLOCK_SIZE, std::make_shared<Block>())
+    {
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    const T& operator[](size_t index) const {
+        return (*blocks_[index / BLOCK_SIZE])[index % BLOCK_SIZE];
+    }
+
+    T& GetMutable(size_t index) {
+        auto& block = blocks_[index / BLOCK_SIZE];
+        // a block held once belongs to this copy alone and is changed in place
+        if (block.use_count() > 1) {
+            block = std::make_shared<Block>(*block);
+        }
+        return (*block)[index % BLOCK_SIZE];
+    }
+
+private:
+    using Block = std::array<T, BLOCK_SIZE>;
+
+    size_t size_ = 0;
+    std::vector<std::shared_ptr<Block>> blocks_;
+};
@@ -1,5 +1,7 @@
 #pragma once
 #include <iostream>
+#include <string_view>
+#include <vector>
 
 struct Document {
     Document();
@@ -18,4 +20,12 @@ enum class DocumentStatus {
     IRRELEVANT,
     BANNED,
     REMOVED,
-};
\ No newline at end of file
+};
+
+// Arguments of one AddDocument call, for indexing documents in bulk
+struct DocumentToAdd {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
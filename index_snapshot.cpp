@@ -0,0 +1,190 @@
+#include "index_snapshot.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std::string_literals;
+
+namespace {
+
+constexpr char SNAPSHOT_MAGIC[8] = { 'S', 'R', 'C', 'H', 'I', 'D', 'X', '\0' };
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t body_size;
+    uint64_t checksum;
+};
+
+uint64_t RotateLeft(uint64_t value, int shift) {
+    return (value << shift) | (value >> (64 - shift));
+}
+
+}  // namespace
+
+MappedFile::MappedFile(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open "s + path);
+    }
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot stat "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Cannot map "s + path);
+        }
+        data_ = static_cast<const uint8_t*>(data);
+    }
+    // the mapping keeps the file alive
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+}
+
+const uint8_t* MappedFile::data() const {
+    return data_;
+}
+
+size_t MappedFile::size() const {
+    return size_;
+}
+
+void SnapshotChecksum::Update(const uint8_t* data, size_t size) {
+    total_size_ += size;
+    while (size > 0 && pending_size_ > 0) {
+        pending_ |= static_cast<uint64_t>(*data++) << (8 * pending_size_);
+        --size;
+        if (++pending_size_ == sizeof(uint64_t)) {
+            Mix(pending_);
+            pending_ = 0;
+            pending_size_ = 0;
+        }
+    }
+    for (; size >= sizeof(uint64_t); data += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        Mix(word);
+    }
+    for (; size > 0; --size) {
+        pending_ |= static_cast<uint64_t>(*data++) << (8 * pending_size_++);
+    }
+}
+
+uint64_t SnapshotChecksum::Finish() const {
+    uint64_t hash = hash_;
+    if (pending_size_ > 0) {
+        hash = RotateLeft(hash ^ (pending_ * 0x87C37B91114253D5ull), 31) * 0x4CF5AD432745937Full;
+    }
+    hash ^= total_size_;
+    // final avalanche from MurmurHash3
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+void SnapshotChecksum::Mix(uint64_t word) {
+    hash_ = RotateLeft(hash_ ^ (word * 0x87C37B91114253D5ull), 31) * 0x4CF5AD432745937Full;
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& path)
+    : out_(path, std::ios::binary | std::ios::trunc)
+{
+    if (!out_) {
+        throw std::runtime_error("Cannot create "s + path);
+    }
+    // the header is filled in by Finish
+    const SnapshotHeader header{};
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    position_ = sizeof(header);
+}
+
+void SnapshotWriter::Finish() {
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.body_size = position_ - sizeof(header);
+    header.checksum = checksum_.Finish();
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.flush();
+    if (!out_) {
+        throw std::runtime_error("Cannot write snapshot"s);
+    }
+}
+
+void SnapshotWriter::WriteBytes(const void* data, size_t size) {
+    out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    checksum_.Update(static_cast<const uint8_t*>(data), size);
+    position_ += size;
+}
+
+void SnapshotWriter::Align(size_t alignment) {
+    static constexpr uint8_t ZEROS[alignof(std::max_align_t)] = {};
+    WriteBytes(ZEROS, (alignment - position_ % alignment) % alignment);
+}
+
+SnapshotReader::SnapshotReader(const std::string& path, SnapshotVerification verification)
+    : file_(std::make_shared<MappedFile>(path))
+{
+    SnapshotHeader header;
+    if (file_->size() < sizeof(header)) {
+        throw std::invalid_argument("Snapshot is truncated"s);
+    }
+    std::memcpy(&header, file_->data(), sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::invalid_argument(path + " is not a snapshot"s);
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        throw std::invalid_argument("Unsupported snapshot version "s + std::to_string(header.version));
+    }
+    if (header.byte_order != BYTE_ORDER_MARK) {
+        throw std::invalid_argument("Snapshot was written with another byte order"s);
+    }
+    if (header.body_size != file_->size() - sizeof(header)) {
+        throw std::invalid_argument("Snapshot is truncated"s);
+    }
+    if (verification == SnapshotVerification::CHECKSUM) {
+        SnapshotChecksum checksum;
+        checksum.Update(file_->data() + sizeof(header), header.body_size);
+        if (checksum.Finish() != header.checksum) {
+            throw std::invalid_argument("Snapshot checksum mismatch"s);
+        }
+    }
+    position_ = sizeof(header);
+}
+
+std::shared_ptr<const MappedFile> SnapshotReader::GetFile() const {
+    return file_;
+}
+
+bool SnapshotReader::IsAtEnd() const {
+    return position_ == file_->size();
+}
+
+const uint8_t* SnapshotReader::Take(size_t size, size_t alignment) {
+    const size_t begin = position_ + (alignment - position_ % alignment) % alignment;
+    if (begin > file_->size() || size > file_->size() - begin) {
+        throw std::invalid_argument("Snapshot is truncated"s);
+    }
+    position_ = begin + size;
+    return file_->data() + begin;
+}
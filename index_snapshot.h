@@ -0,0 +1,132 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+// Binary snapshot files. A fixed header (magic, format version, byte order, body
+// size and checksum) is followed by the body: plain arrays of trivially copyable
+// values, every value aligned to its own alignment relative to the file start.
+// The byte order is the native one, a snapshot from a machine with another byte
+// order is rejected. The reader maps the file, so arrays are used in place.
+
+constexpr uint32_t SNAPSHOT_VERSION = 3;
+
+// What the reader verifies when it opens a file. STRUCTURE skips the checksum of the
+// body, which reads the whole file; reads stay bounds checked either way
+enum class SnapshotVerification {
+    CHECKSUM,
+    STRUCTURE,
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    const uint8_t* data() const;
+
+    size_t size() const;
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// 64-bit checksum of a byte stream that may be fed in pieces of any size
+class SnapshotChecksum {
+public:
+    void Update(const uint8_t* data, size_t size);
+
+    uint64_t Finish() const;
+
+private:
+    uint64_t hash_ = 0x9E3779B97F4A7C15ull;
+    uint64_t pending_ = 0;
+    size_t pending_size_ = 0;
+    uint64_t total_size_ = 0;
+
+    void Mix(uint64_t word);
+};
+
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path);
+
+    template <typename T>
+    void Write(const T& value);
+
+    template <typename T>
+    void WriteArray(const T* values, size_t count);
+
+    // Fills in the header, nothing can be written afterwards
+    void Finish();
+
+private:
+    std::ofstream out_;
+    SnapshotChecksum checksum_;
+    uint64_t position_ = 0;
+
+    void WriteBytes(const void* data, size_t size);
+
+    void Align(size_t alignment);
+};
+
+// Reads the values in the order they were written. The header, and unless told
+// otherwise the body checksum, are verified when the file is opened, every read is
+// bounds checked; pointers returned by ReadArray stay valid as long as the file
+// returned by GetFile is alive.
+class SnapshotReader {
+public:
+    explicit SnapshotReader(const std::string& path, SnapshotVerification verification = SnapshotVerification::CHECKSUM);
+
+    template <typename T>
+    T Read();
+
+    template <typename T>
+    const T* ReadArray(size_t count);
+
+    std::shared_ptr<const MappedFile> GetFile() const;
+
+    bool IsAtEnd() const;
+
+private:
+    std::shared_ptr<const MappedFile> file_;
+    size_t position_ = 0;
+
+    const uint8_t* Take(size_t size, size_t alignment);
+};
+
+template <typename T>
+void SnapshotWriter::Write(const T& value) {
+    WriteArray(&value, 1);
+}
+
+template <typename T>
+void SnapshotWriter::WriteArray(const T* values, size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    Align(alignof(T));
+    WriteBytes(values, count * sizeof(T));
+}
+
+template <typename T>
+T SnapshotReader::Read() {
+    return *ReadArray<T>(1);
+}
+
+template <typename T>
+const T* SnapshotReader::ReadArray(size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (count > file_->size() / sizeof(T)) {
+        throw std::invalid_argument("Snapshot is truncated");
+    }
+    return reinterpret_cast<const T*>(Take(count * sizeof(T), alignof(T)));
+}
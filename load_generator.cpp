@@ -0,0 +1,264 @@
+#include "load_generator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "search_server.h"
+#include "sharded_search_server.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double GetSeconds(Clock::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+}
+
+// Kilobytes on Linux
+long GetPeakRss() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+struct LoadQuery {
+    std::string text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+};
+
+struct QueryMix {
+    const char* name;
+    int plus_word_count;
+    int minus_word_count;
+    bool is_status_filtered; // filters by a status drawn like the statuses of the corpus
+};
+
+constexpr QueryMix QUERY_MIXES[] = {
+    { "single_term", 1, 0, false },
+    { "multi_term", 3, 0, false },
+    { "minus_heavy", 2, 3, false },
+    { "status", 2, 0, true },
+};
+
+// Share of every DocumentStatus in the corpus: ACTUAL documents dominate, like in
+// production. Status-filtered queries ask for the statuses in the same proportions
+constexpr double STATUS_WEIGHTS[] = { 85, 10, 4, 1 };
+
+class Corpus {
+public:
+    explicit Corpus(const LoadGeneratorOptions& options)
+        : generator_(options.seed)
+    {
+        std::vector<double> weights(options.vocabulary_size);
+        for (int rank = 0; rank < options.vocabulary_size; ++rank) {
+            weights[rank] = 1.0 / std::pow(rank + 1.0, options.zipf_exponent);
+        }
+        word_rank_ = std::discrete_distribution<int>(weights.begin(), weights.end());
+
+        std::discrete_distribution<int> status_index(std::begin(STATUS_WEIGHTS), std::end(STATUS_WEIGHTS));
+        texts_.resize(options.document_count);
+        documents_.resize(options.document_count);
+        for (int id = 0; id < options.document_count; ++id) {
+            for (int i = 0; i < options.words_per_document; ++i) {
+                texts_[id] += MakeWord();
+                texts_[id] += ' ';
+            }
+            text_size_ += texts_[id].size();
+            documents_[id] = { id, texts_[id], static_cast<DocumentStatus>(status_index(generator_)), { id % 10, 5 } };
+        }
+    }
+
+    const std::vector<DocumentToAdd>& GetDocuments() const {
+        return documents_;
+    }
+
+    size_t GetTextSize() const {
+        return text_size_;
+    }
+
+    std::vector<LoadQuery> MakeQueries(const QueryMix& mix, int query_count) {
+        std::vector<LoadQuery> queries(query_count);
+        std::discrete_distribution<int> status_index(std::begin(STATUS_WEIGHTS), std::end(STATUS_WEIGHTS));
+        for (auto& query : queries) {
+            for (int i = 0; i < mix.plus_word_count + mix.minus_word_count; ++i) {
+                query.text += i < mix.plus_word_count ? ""s : "-"s;
+                query.text += MakeWord();
+                query.text += ' ';
+            }
+            if (mix.is_status_filtered) {
+                query.status = static_cast<DocumentStatus>(status_index(generator_));
+            }
+        }
+        return queries;
+    }
+
+private:
+    std::mt19937 generator_;
+    std::discrete_distribution<int> word_rank_;
+    std::vector<std::string> texts_;
+    std::vector<DocumentToAdd> documents_;
+    size_t text_size_ = 0;
+
+    std::string MakeWord() {
+        return "w"s + std::to_string(word_rank_(generator_));
+    }
+};
+
+struct RunResult {
+    double seconds = 0.0;
+    std::vector<double> latencies; // microseconds, ascending
+};
+
+// Every client thread replays its share of the queries one by one
+template <typename Search>
+RunResult ReplayQueries(const std::vector<LoadQuery>& queries, size_t client_count, Search search) {
+    RunResult result;
+    result.latencies.resize(queries.size());
+    const auto start = Clock::now();
+    std::vector<std::thread> clients;
+    for (size_t client = 0; client < client_count; ++client) {
+        clients.emplace_back([&, client] {
+            for (size_t i = client; i < queries.size(); i += client_count) {
+                const auto query_start = Clock::now();
+                search(queries[i]);
+                result.latencies[i] = GetSeconds(Clock::now() - query_start) * 1e6;
+            }
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    result.seconds = GetSeconds(Clock::now() - start);
+    std::sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+double GetPercentile(const std::vector<double>& sorted_values, double fraction) {
+    if (sorted_values.empty()) {
+        return 0.0;
+    }
+    const auto rank = static_cast<size_t>(std::ceil(fraction * sorted_values.size()));
+    return sorted_values[std::clamp<size_t>(rank, 1, sorted_values.size()) - 1];
+}
+
+size_t ParseCount(std::string_view value) {
+    const auto count = std::stoll(std::string(value));
+    if (count <= 0) {
+        throw std::invalid_argument("Load generator option must be positive"s);
+    }
+    return static_cast<size_t>(count);
+}
+
+}  // namespace
+
+LoadGeneratorOptions ParseLoadGeneratorOptions(int argc, const char* const* argv) {
+    LoadGeneratorOptions options;
+    for (int i = 0; i < argc; ++i) {
+        const std::string_view argument = argv[i];
+        const auto separator = argument.find('=');
+        if (argument.substr(0, 2) != "--" || separator == argument.npos) {
+            throw std::invalid_argument("Invalid load generator option "s + std::string(argument));
+        }
+        const auto name = argument.substr(2, separator - 2);
+        const auto value = argument.substr(separator + 1);
+        if (name == "documents") {
+            options.document_count = static_cast<int>(ParseCount(value));
+        }
+        else if (name == "vocabulary") {
+            options.vocabulary_size = static_cast<int>(ParseCount(value));
+        }
+        else if (name == "words") {
+            options.words_per_document = static_cast<int>(ParseCount(value));
+        }
+        else if (name == "zipf") {
+            options.zipf_exponent = std::stod(std::string(value));
+        }
+        else if (name == "queries") {
+            options.query_count = static_cast<int>(ParseCount(value));
+        }
+        else if (name == "clients") {
+            options.client_count = ParseCount(value);
+        }
+        else if (name == "shards") {
+            options.shard_count = ParseCount(value);
+        }
+        else if (name == "seed") {
+            options.seed = static_cast<unsigned>(std::stoul(std::string(value)));
+        }
+        else {
+            throw std::invalid_argument("Unknown load generator option "s + std::string(argument));
+        }
+    }
+    return options;
+}
+
+void RunLoadGenerator(const LoadGeneratorOptions& options, std::ostream& out) {
+    Corpus corpus(options);
+    const auto& documents = corpus.GetDocuments();
+    const double text_mb = corpus.GetTextSize() / (1024.0 * 1024.0);
+
+    SearchServer search_server("and with"s);
+    auto start = Clock::now();
+    search_server.AddDocuments(documents);
+    const double ingestion_seconds = GetSeconds(Clock::now() - start);
+
+    ShardedSearchServer sharded_server("and with"sv, options.shard_count);
+    start = Clock::now();
+    sharded_server.AddDocuments(documents);
+    const double sharded_ingestion_seconds = GetSeconds(Clock::now() - start);
+
+    out << "{\n";
+    out << "  \"options\": {\"documents\": " << options.document_count << ", \"vocabulary\": " << options.vocabulary_size
+        << ", \"words_per_document\": " << options.words_per_document << ", \"zipf_exponent\": " << options.zipf_exponent
+        << ", \"queries\": " << options.query_count << ", \"clients\": " << options.client_count
+        << ", \"shards\": " << options.shard_count << ", \"seed\": " << options.seed
+        << ", \"threads\": " << ThreadPool::GetDefault().GetThreadCount() << "},\n";
+    out << "  \"ingestion\": [\n";
+    out << "    {\"mode\": \"single\", \"seconds\": " << ingestion_seconds
+        << ", \"documents_per_second\": " << documents.size() / ingestion_seconds
+        << ", \"mb_per_second\": " << text_mb / ingestion_seconds << "},\n";
+    out << "    {\"mode\": \"sharded\", \"seconds\": " << sharded_ingestion_seconds
+        << ", \"documents_per_second\": " << documents.size() / sharded_ingestion_seconds
+        << ", \"mb_per_second\": " << text_mb / sharded_ingestion_seconds << "}\n";
+    out << "  ],\n";
+    out << "  \"peak_rss_kb_after_ingestion\": " << GetPeakRss() << ",\n";
+
+    out << "  \"queries\": [";
+    bool is_first_run = true;
+    for (const auto& mix : QUERY_MIXES) {
+        const auto queries = corpus.MakeQueries(mix, options.query_count);
+        const std::pair<const char*, RunResult> runs[] = {
+            { "seq", ReplayQueries(queries, options.client_count, [&](const LoadQuery& query) {
+                return search_server.FindTopDocuments(std::execution::seq, query.text, query.status);
+            }) },
+            { "par", ReplayQueries(queries, options.client_count, [&](const LoadQuery& query) {
+                return search_server.FindTopDocuments(std::execution::par, query.text, query.status);
+            }) },
+            { "sharded", ReplayQueries(queries, options.client_count, [&](const LoadQuery& query) {
+                return sharded_server.FindTopDocuments(query.text, query.status);
+            }) },
+        };
+        for (const auto& [mode, run] : runs) {
+            out << (is_first_run ? "\n" : ",\n");
+            is_first_run = false;
+            out << "    {\"mix\": \"" << mix.name << "\", \"mode\": \"" << mode << "\", \"queries_per_second\": "
+                << queries.size() / run.seconds << ", \"latency_us\": {\"p50\": " << GetPercentile(run.latencies, 0.5)
+                << ", \"p99\": " << GetPercentile(run.latencies, 0.99) << ", \"p999\": " << GetPercentile(run.latencies, 0.999)
+                << ", \"max\": " << run.latencies.back() << "}}";
+        }
+    }
+    out << "\n  ],\n";
+    out << "  \"peak_rss_kb\": " << GetPeakRss() << "\n";
+    out << "}\n";
+}
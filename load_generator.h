@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <ostream>
+
+// Load generator of search_server_bench: indexes a synthetic corpus whose words follow
+// a Zipf distribution, replays query mixes against every search mode and reports
+// ingestion rate, throughput, latency percentiles and peak RSS as one JSON object,
+// so runs of different releases can be compared by a script.
+struct LoadGeneratorOptions {
+    int document_count = 200'000;
+    int vocabulary_size = 100'000;
+    int words_per_document = 30;
+    double zipf_exponent = 1.0;  // word of rank r is drawn with weight 1 / r^zipf_exponent
+    int query_count = 5'000;     // per query mix and search mode
+    size_t client_count = 1;     // threads issuing queries at the same time
+    size_t shard_count = 4;
+    unsigned seed = 1;
+};
+
+// Reads --documents=, --vocabulary=, --words=, --zipf=, --queries=, --clients=,
+// --shards= and --seed= arguments. Throws invalid_argument for anything else
+LoadGeneratorOptions ParseLoadGeneratorOptions(int argc, const char* const* argv);
+
+void RunLoadGenerator(const LoadGeneratorOptions& options, std::ostream& out);
@@ -2,12 +2,14 @@
 
 #include <chrono>
 #include <iostream>
+#include <string>
 
 #define PROFILE_CONCAT_INTERNAL(X,cerr, Y) X##Y
 #define PROFILE_CONCAT(X, cerr, Y) PROFILE_CONCAT_INTERNAL(X, cerr, Y)
 #define UNIQUE_VAR_NAME_PROFILE PROFILE_CONCAT(profileGuard, cerr, __LINE__)
 #define  LOG_DURATION_STREAM(x, cerr) LogDuration UNIQUE_VAR_NAME_PROFILE(x, cerr)
 
+// Prints how long the object lived to the stream it was given, std::cerr by default
 class LogDuration {
 public:
     // ������� ��� ���� std::chrono::steady_clock
@@ -25,7 +27,7 @@ public:
 
         const auto end_time = Clock::now();
         const auto dur = end_time - start_time_;
-        std::cerr << id_ << ": "s << duration_cast<milliseconds>(dur).count() << " ms"s << std::endl;
+        cout_ << id_ << ": "s << duration_cast<milliseconds>(dur).count() << " ms"s << std::endl;
     }
 
 private:
@@ -0,0 +1,225 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+using PhaseHistogram = MetricsSnapshot::PhaseHistogram;
+
+// Written by its thread only, read by CollectMetrics at any time
+struct ThreadMetrics {
+    struct Phase {
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> total_ns{ 0 };
+        std::array<std::atomic<uint64_t>, PhaseHistogram::BUCKET_COUNT> buckets{};
+    };
+
+    std::array<Phase, METRIC_PHASE_COUNT> phases;
+    std::array<std::atomic<uint64_t>, METRIC_COUNTER_COUNT> counters{};
+
+    void AddTo(MetricsSnapshot& metrics) const;
+};
+
+// A plain store is enough, no other thread writes the value
+void Increase(std::atomic<uint64_t>& value, uint64_t delta) {
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+void ThreadMetrics::AddTo(MetricsSnapshot& metrics) const {
+    for (size_t i = 0; i < METRIC_PHASE_COUNT; ++i) {
+        auto& phase = metrics.phases[i];
+        phase.count += phases[i].count.load(std::memory_order_relaxed);
+        phase.total_ns += phases[i].total_ns.load(std::memory_order_relaxed);
+        for (size_t bucket = 0; bucket < PhaseHistogram::BUCKET_COUNT; ++bucket) {
+            phase.buckets[bucket] += phases[i].buckets[bucket].load(std::memory_order_relaxed);
+        }
+    }
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+        metrics.counters[i] += counters[i].load(std::memory_order_relaxed);
+    }
+}
+
+struct MetricsRegistry {
+    std::mutex mutex;
+    std::vector<const ThreadMetrics*> threads;
+    MetricsSnapshot exited_threads;
+};
+
+// Never destroyed, threads may exit after the static objects are gone
+MetricsRegistry& GetRegistry() {
+    static auto* registry = new MetricsRegistry;
+    return *registry;
+}
+
+// Registers the metrics of the thread while it is alive
+class ThreadMetricsHolder {
+public:
+    ThreadMetricsHolder() {
+        auto& registry = GetRegistry();
+        std::lock_guard guard(registry.mutex);
+        registry.threads.push_back(&metrics_);
+    }
+
+    ~ThreadMetricsHolder() {
+        auto& registry = GetRegistry();
+        std::lock_guard guard(registry.mutex);
+        metrics_.AddTo(registry.exited_threads);
+        registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), &metrics_));
+    }
+
+    ThreadMetrics& Get() {
+        return metrics_;
+    }
+
+private:
+    ThreadMetrics metrics_;
+};
+
+ThreadMetrics& GetThreadMetrics() {
+    thread_local ThreadMetricsHolder holder;
+    return holder.Get();
+}
+
+size_t GetDurationBucket(uint64_t nanoseconds) {
+    size_t bucket = 0;
+    while (nanoseconds > 0 && bucket + 1 < PhaseHistogram::BUCKET_COUNT) {
+        nanoseconds >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+}  // namespace
+
+const char* GetMetricPhaseName(MetricPhase phase) {
+    switch (phase) {
+    case MetricPhase::PARSE:
+        return "parse";
+    case MetricPhase::TERM_LOOKUP:
+        return "term_lookup";
+    case MetricPhase::SCORING:
+        return "scoring";
+    case MetricPhase::MINUS_FILTERING:
+        return "minus_filtering";
+    case MetricPhase::TOP_K:
+        return "top_k";
+    case MetricPhase::MATCH_DOCUMENT:
+        return "match_document";
+    case MetricPhase::ADD_DOCUMENT:
+        return "add_document";
+    case MetricPhase::PROCESS_QUERIES:
+        return "process_queries";
+    }
+    return "unknown";
+}
+
+const char* GetMetricCounterName(MetricCounter counter) {
+    switch (counter) {
+    case MetricCounter::POSTINGS_SCORED:
+        return "postings_scored";
+    case MetricCounter::DOCUMENTS_MATCHED:
+        return "documents_matched";
+    case MetricCounter::CACHE_HITS:
+        return "cache_hits";
+    case MetricCounter::CACHE_MISSES:
+        return "cache_misses";
+    case MetricCounter::DOCUMENTS_ADDED:
+        return "documents_added";
+    case MetricCounter::QUERIES_PROCESSED:
+        return "queries_processed";
+    }
+    return "unknown";
+}
+
+uint64_t MetricsSnapshot::PhaseHistogram::GetPercentile(double fraction) const {
+    uint64_t total_count = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        total_count += buckets[bucket];
+        if (total_count > 0 && total_count >= fraction * count) {
+            return uint64_t(1) << bucket;
+        }
+    }
+    return 0;
+}
+
+const MetricsSnapshot::PhaseHistogram& MetricsSnapshot::operator[](MetricPhase phase) const {
+    return phases[static_cast<size_t>(phase)];
+}
+
+uint64_t MetricsSnapshot::operator[](MetricCounter counter) const {
+    return counters[static_cast<size_t>(counter)];
+}
+
+MetricsSnapshot CollectMetrics() {
+    auto& registry = GetRegistry();
+    std::lock_guard guard(registry.mutex);
+    MetricsSnapshot metrics = registry.exited_threads;
+    for (const ThreadMetrics* thread_metrics : registry.threads) {
+        thread_metrics->AddTo(metrics);
+    }
+    return metrics;
+}
+
+void WritePrometheusMetrics(std::ostream& out, const MetricsSnapshot& metrics) {
+    out << "# HELP search_server_phase_seconds Duration of search server phases.\n";
+    out << "# TYPE search_server_phase_seconds histogram\n";
+    for (size_t i = 0; i < METRIC_PHASE_COUNT; ++i) {
+        const auto& phase = metrics.phases[i];
+        const char* name = GetMetricPhaseName(static_cast<MetricPhase>(i));
+        // buckets above the slowest phase would only repeat the count
+        size_t bucket_end = PhaseHistogram::BUCKET_COUNT;
+        while (bucket_end > 0 && phase.buckets[bucket_end - 1] == 0) {
+            --bucket_end;
+        }
+        uint64_t cumulative_count = 0;
+        for (size_t bucket = 0; bucket < bucket_end; ++bucket) {
+            cumulative_count += phase.buckets[bucket];
+            out << "search_server_phase_seconds_bucket{phase=\"" << name << "\",le=\""
+                << static_cast<double>(uint64_t(1) << bucket) * 1e-9 << "\"} " << cumulative_count << '\n';
+        }
+        out << "search_server_phase_seconds_bucket{phase=\"" << name << "\",le=\"+Inf\"} " << phase.count << '\n';
+        out << "search_server_phase_seconds_sum{phase=\"" << name << "\"} " << phase.total_ns * 1e-9 << '\n';
+        out << "search_server_phase_seconds_count{phase=\"" << name << "\"} " << phase.count << '\n';
+    }
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+        const char* name = GetMetricCounterName(static_cast<MetricCounter>(i));
+        out << "# TYPE search_server_" << name << "_total counter\n";
+        out << "search_server_" << name << "_total " << metrics.counters[i] << '\n';
+    }
+}
+
+void WriteJsonMetrics(std::ostream& out, const MetricsSnapshot& metrics) {
+    out << "{\"phases\": {";
+    for (size_t i = 0; i < METRIC_PHASE_COUNT; ++i) {
+        const auto& phase = metrics.phases[i];
+        out << (i == 0 ? "" : ", ") << '"' << GetMetricPhaseName(static_cast<MetricPhase>(i)) << "\": {\"count\": "
+            << phase.count << ", \"total_ns\": " << phase.total_ns << ", \"p50_ns\": " << phase.GetPercentile(0.5)
+            << ", \"p99_ns\": " << phase.GetPercentile(0.99) << ", \"buckets\": [";
+        for (size_t bucket = 0; bucket < PhaseHistogram::BUCKET_COUNT; ++bucket) {
+            out << (bucket == 0 ? "" : ", ") << phase.buckets[bucket];
+        }
+        out << "]}";
+    }
+    out << "}, \"counters\": {";
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+        out << (i == 0 ? "" : ", ") << '"' << GetMetricCounterName(static_cast<MetricCounter>(i)) << "\": "
+            << metrics.counters[i];
+    }
+    out << "}}";
+}
+
+void RecordMetricPhase(MetricPhase phase, std::chrono::steady_clock::duration duration) {
+    const auto nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    auto& metrics = GetThreadMetrics().phases[static_cast<size_t>(phase)];
+    Increase(metrics.count, 1);
+    Increase(metrics.total_ns, nanoseconds);
+    Increase(metrics.buckets[GetDurationBucket(nanoseconds)], 1);
+}
+
+void AddMetricCounter(MetricCounter counter, uint64_t value) {
+    Increase(GetThreadMetrics().counters[static_cast<size_t>(counter)], value);
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Timings of the phases of query evaluation and indexing plus event counters.
+// Every thread records into its own histograms, which only that thread writes, so
+// recording takes no lock and no read-modify-write; CollectMetrics sums the threads
+// when it is called. Building with SEARCH_SERVER_METRICS=0 removes the recording
+// macros from the hot paths entirely; the collection functions then report zeros.
+
+#ifndef SEARCH_SERVER_METRICS
+#define SEARCH_SERVER_METRICS 1
+#endif
+
+enum class MetricPhase {
+    PARSE,           // splitting and deduplicating query words
+    TERM_LOOKUP,     // resolving words to terms and computing IDF
+    SCORING,         // evaluating postings, includes minus words under dynamic pruning
+    MINUS_FILTERING, // excluding documents with minus words under exhaustive evaluation
+    TOP_K,           // merging the tops of the chunks
+    MATCH_DOCUMENT,
+    ADD_DOCUMENT,
+    PROCESS_QUERIES, // a whole batch
+};
+
+enum class MetricCounter {
+    POSTINGS_SCORED,
+    DOCUMENTS_MATCHED, // documents that passed the minus words and the predicate
+    CACHE_HITS,
+    CACHE_MISSES,
+    DOCUMENTS_ADDED,
+    QUERIES_PROCESSED,
+};
+
+constexpr size_t METRIC_PHASE_COUNT = static_cast<size_t>(MetricPhase::PROCESS_QUERIES) + 1;
+constexpr size_t METRIC_COUNTER_COUNT = static_cast<size_t>(MetricCounter::QUERIES_PROCESSED) + 1;
+
+const char* GetMetricPhaseName(MetricPhase phase);
+
+const char* GetMetricCounterName(MetricCounter counter);
+
+struct MetricsSnapshot {
+    // Bucket 0 counts phases shorter than a nanosecond, bucket i > 0 the ones that
+    // took [2^(i-1), 2^i) nanoseconds
+    struct PhaseHistogram {
+        static constexpr size_t BUCKET_COUNT = 40;
+
+        uint64_t count = 0;
+        uint64_t total_ns = 0;
+        std::array<uint64_t, BUCKET_COUNT> buckets{};
+
+        // Upper bound in nanoseconds of the bucket reached by the given fraction of phases
+        uint64_t GetPercentile(double fraction) const;
+    };
+
+    std::array<PhaseHistogram, METRIC_PHASE_COUNT> phases{};
+    std::array<uint64_t, METRIC_COUNTER_COUNT> counters{};
+
+    const PhaseHistogram& operator[](MetricPhase phase) const;
+
+    uint64_t operator[](MetricCounter counter) const;
+};
+
+// Sums the metrics of every thread, including the threads that have exited
+MetricsSnapshot CollectMetrics();
+
+// Prometheus text exposition format: a histogram per phase and a counter per event
+void WritePrometheusMetrics(std::ostream& out, const MetricsSnapshot& metrics);
+
+void WriteJsonMetrics(std::ostream& out, const MetricsSnapshot& metrics);
+
+void RecordMetricPhase(MetricPhase phase, std::chrono::steady_clock::duration duration);
+
+void AddMetricCounter(MetricCounter counter, uint64_t value);
+
+// Records the time from construction to destruction as one phase
+class MetricPhaseTimer {
+public:
+    explicit MetricPhaseTimer(MetricPhase phase)
+        : phase_(phase) {
+    }
+
+    MetricPhaseTimer(const MetricPhaseTimer&) = delete;
+    MetricPhaseTimer& operator=(const MetricPhaseTimer&) = delete;
+
+    ~MetricPhaseTimer() {
+        RecordMetricPhase(phase_, std::chrono::steady_clock::now() - start_time_);
+    }
+
+private:
+    const MetricPhase phase_;
+    const std::chrono::steady_clock::time_point start_time_ = std::chrono::steady_clock::now();
+};
+
+#define METRICS_CONCAT_INTERNAL(X, Y) X##Y
+#define METRICS_CONCAT(X, Y) METRICS_CONCAT_INTERNAL(X, Y)
+
+#if SEARCH_SERVER_METRICS
+#define METRICS_TIME_PHASE(phase) MetricPhaseTimer METRICS_CONCAT(metricPhaseTimer, __LINE__)(MetricPhase::phase)
+#define METRICS_ADD(counter, value) AddMetricCounter(MetricCounter::counter, (value))
+#else
+#define METRICS_TIME_PHASE(phase) static_cast<void>(0)
+#define METRICS_ADD(counter, value) static_cast<void>(sizeof(value))
+#endif
@@ -0,0 +1,66 @@
+#include "posting_kernels.h"
+
+size_t DifferenceScores(const int* a, const double* a_scores, size_t a_size,
+    const int* b, size_t b_size, int* out, double* out_scores) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < a_size) {
+        while (j < b_size && b[j] < a[i]) {
+            ++j;
+        }
+        const bool skip = j < b_size && b[j] == a[i];
+        out[k] = a[i];
+        out_scores[k] = a_scores[i];
+        k += !skip;
+        ++i;
+    }
+    return k;
+}
+
+size_t UnionScores(const int* a, const double* a_scores, size_t a_size,
+    const int* b, const double* b_scores, size_t b_size, int* out, double* out_scores) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < a_size && j < b_size) {
+        if (a[i] < b[j]) {
+            out[k] = a[i];
+            out_scores[k] = a_scores[i++];
+        }
+        else if (b[j] < a[i]) {
+            out[k] = b[j];
+            out_scores[k] = b_scores[j++];
+        }
+        else {
+            out[k] = a[i];
+            out_scores[k] = a_scores[i++] + b_scores[j++];
+        }
+        ++k;
+    }
+    for (; i < a_size; ++i, ++k) {
+        out[k] = a[i];
+        out_scores[k] = a_scores[i];
+    }
+    for (; j < b_size; ++j, ++k) {
+        out[k] = b[j];
+        out_scores[k] = b_scores[j];
+    }
+    return k;
+}
+
+ScoredOrdinals UnionScores(const ScoredOrdinals& lhs, const ScoredOrdinals& rhs) {
+    ScoredOrdinals result;
+    const size_t capacity = lhs.ordinals.size() + rhs.ordinals.size();
+    result.ordinals.resize(capacity);
+    result.scores.resize(capacity);
+    const size_t size = UnionScores(lhs.ordinals.data(), lhs.scores.data(), lhs.ordinals.size(),
+        rhs.ordinals.data(), rhs.scores.data(), rhs.ordinals.size(),
+        result.ordinals.data(), result.scores.data());
+    result.ordinals.resize(size);
+    result.scores.resize(size);
+    return result;
+}
+
+void DifferenceScores(ScoredOrdinals& lhs, const std::vector<int>& rhs) {
+    const size_t size = DifferenceScores(lhs.ordinals.data(), lhs.scores.data(), lhs.ordinals.size(),
+        rhs.data(), rhs.size(), lhs.ordinals.data(), lhs.scores.data());
+    lhs.ordinals.resize(size);
+    lhs.scores.resize(size);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Set operations over ascending lists of unique document ordinals. Query evaluation
+// does not use them: the dense ScoreAccumulator and Block-Max WAND replaced them, they
+// stay as the baseline of search_server_bench.
+
+// Elements of a that are not in b, scores travel with their ordinals.
+// out/out_scores must have room for a_size elements and may alias a/a_scores.
+size_t DifferenceScores(const int* a, const double* a_scores, size_t a_size,
+    const int* b, size_t b_size, int* out, double* out_scores);
+
+// Ordinals present in either list, scores of common ordinals are added.
+// out/out_scores must have room for a_size + b_size elements.
+size_t UnionScores(const int* a, const double* a_scores, size_t a_size,
+    const int* b, const double* b_scores, size_t b_size, int* out, double* out_scores);
+
+struct ScoredOrdinals {
+    std::vector<int> ordinals;
+    std::vector<double> scores;
+};
+
+ScoredOrdinals UnionScores(const ScoredOrdinals& lhs, const ScoredOrdinals& rhs);
+
+void DifferenceScores(ScoredOrdinals& lhs, const std::vector<int>& rhs);
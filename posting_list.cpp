@@ -0,0 +1,206 @@
+#include "posting_list.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include "index_snapshot.h"
+
+namespace {
+
+void WriteVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t ReadVarint(const uint8_t*& in) {
+    uint32_t value = *in & 0x7f;
+    for (int shift = 7; *in++ & 0x80; shift += 7) {
+        value |= static_cast<uint32_t>(*in & 0x7f) << shift;
+    }
+    return value;
+}
+
+}  // namespace
+
+void PostingList::Append(int ordinal, uint32_t count, double term_freq) {
+    MakeOwned();
+    if (blocks_.empty() || blocks_.back().size == BLOCK_SIZE) {
+        blocks_.push_back({ ordinal, ordinal, static_cast<uint32_t>(bytes_.size()), 0, 0.0 });
+    }
+    Block& block = blocks_.back();
+    WriteVarint(bytes_, static_cast<uint32_t>(ordinal - block.last_ordinal));
+    WriteVarint(bytes_, count);
+    block.last_ordinal = ordinal;
+    block.max_term_freq = std::max(block.max_term_freq, term_freq);
+    ++block.size;
+    ++size_;
+    max_term_freq_ = std::max(max_term_freq_, term_freq);
+}
+
+bool PostingList::Contains(int ordinal) const {
+    const size_t block_index = FindBlock(ordinal);
+    if (block_index == GetBlockCount()) {
+        return false;
+    }
+    Buffer buffer;
+    const size_t count = DecodeBlock(block_index, buffer);
+    return std::binary_search(buffer.ordinals, buffer.ordinals + count, ordinal);
+}
+
+size_t PostingList::size() const {
+    return size_;
+}
+
+size_t PostingList::GetBlockCount() const {
+    return is_mapped_ ? mapped_block_count_ : blocks_.size();
+}
+
+double PostingList::GetMaxTermFreq() const {
+    return max_term_freq_;
+}
+
+size_t PostingList::DecodeBlock(size_t block_index, Buffer& buffer) const {
+    const Block& block = GetBlocks()[block_index];
+    const uint8_t* in = GetBytes() + block.offset;
+    int ordinal = block.first_ordinal;
+    for (uint32_t i = 0; i < block.size; ++i) {
+        ordinal += static_cast<int>(ReadVarint(in));
+        buffer.ordinals[i] = ordinal;
+        buffer.counts[i] = ReadVarint(in);
+    }
+    return block.size;
+}
+
+size_t PostingList::GetMemoryUsage() const {
+    return sizeof(*this) + blocks_.capacity() * sizeof(Block) + bytes_.capacity();
+}
+
+void PostingList::Save(SnapshotWriter& writer) const {
+    static_assert(std::is_trivially_copyable_v<Block>);
+    writer.Write<uint64_t>(size_);
+    writer.Write(max_term_freq_);
+    writer.Write<uint64_t>(GetBlockCount());
+    writer.WriteArray(GetBlocks(), GetBlockCount());
+    writer.Write<uint64_t>(GetByteCount());
+    writer.WriteArray(GetBytes(), GetByteCount());
+}
+
+PostingList PostingList::Load(SnapshotReader& reader) {
+    PostingList postings;
+    postings.size_ = reader.Read<uint64_t>();
+    postings.max_term_freq_ = reader.Read<double>();
+    postings.is_mapped_ = true;
+    postings.mapped_block_count_ = reader.Read<uint64_t>();
+    postings.mapped_blocks_ = reader.ReadArray<Block>(postings.mapped_block_count_);
+    postings.mapped_byte_count_ = reader.Read<uint64_t>();
+    postings.mapped_bytes_ = reader.ReadArray<uint8_t>(postings.mapped_byte_count_);
+    for (size_t i = 0; i < postings.mapped_block_count_; ++i) {
+        const Block& block = postings.mapped_blocks_[i];
+        if (block.size == 0 || block.size > BLOCK_SIZE || block.offset > postings.mapped_byte_count_
+            || (i > 0 && block.offset < postings.mapped_blocks_[i - 1].offset)) {
+            throw std::invalid_argument("Snapshot posting list is corrupted");
+        }
+    }
+    return postings;
+}
+
+const PostingList::Block* PostingList::GetBlocks() const {
+    return is_mapped_ ? mapped_blocks_ : blocks_.data();
+}
+
+const uint8_t* PostingList::GetBytes() const {
+    return is_mapped_ ? mapped_bytes_ : bytes_.data();
+}
+
+size_t PostingList::GetByteCount() const {
+    return is_mapped_ ? mapped_byte_count_ : bytes_.size();
+}
+
+void PostingList::MakeOwned() {
+    if (!is_mapped_) {
+        return;
+    }
+    blocks_.assign(mapped_blocks_, mapped_blocks_ + mapped_block_count_);
+    bytes_.assign(mapped_bytes_, mapped_bytes_ + mapped_byte_count_);
+    is_mapped_ = false;
+    mapped_blocks_ = nullptr;
+    mapped_block_count_ = 0;
+    mapped_bytes_ = nullptr;
+    mapped_byte_count_ = 0;
+}
+
+size_t PostingList::FindBlock(int ordinal) const {
+    const Block* blocks = GetBlocks();
+    const size_t block_count = GetBlockCount();
+    const Block* it = std::lower_bound(blocks, blocks + block_count, ordinal,
+        [](const Block& block, int value) {
+            return block.last_ordinal < value;
+        });
+    if (it == blocks + block_count || it->first_ordinal > ordinal) {
+        return block_count;
+    }
+    return it - blocks;
+}
+
+PostingList::Cursor::Cursor(const PostingList& postings)
+    : postings_(&postings) {
+    LoadBlock(0);
+}
+
+void PostingList::Cursor::NextGeq(int target) {
+    if (ordinal_ >= target) {
+        return;
+    }
+    const Block* blocks = postings_->GetBlocks();
+    if (blocks[block_].last_ordinal < target) {
+        const Block* it = std::lower_bound(blocks + block_ + 1, blocks + postings_->GetBlockCount(), target,
+            [](const Block& block, int value) {
+                return block.last_ordinal < value;
+            });
+        LoadBlock(it - blocks);
+        if (ordinal_ >= target) {
+            return;
+        }
+    }
+    position_ = std::lower_bound(buffer_.ordinals + position_, buffer_.ordinals + block_size_, target)
+        - buffer_.ordinals;
+    ordinal_ = buffer_.ordinals[position_];
+}
+
+void PostingList::Cursor::ShallowSeek(int target) {
+    const Block* blocks = postings_->GetBlocks();
+    const size_t block_count = postings_->GetBlockCount();
+    shallow_block_ = std::max(shallow_block_, block_);
+    if (shallow_block_ < block_count && blocks[shallow_block_].last_ordinal < target) {
+        shallow_block_ = std::lower_bound(blocks + shallow_block_ + 1, blocks + block_count, target,
+            [](const Block& block, int value) {
+                return block.last_ordinal < value;
+            }) - blocks;
+    }
+}
+
+double PostingList::Cursor::GetBlockMaxTermFreq() const {
+    return shallow_block_ < postings_->GetBlockCount() ? postings_->GetBlocks()[shallow_block_].max_term_freq : 0.0;
+}
+
+int PostingList::Cursor::GetBlockLastOrdinal() const {
+    return shallow_block_ < postings_->GetBlockCount() ? postings_->GetBlocks()[shallow_block_].last_ordinal : END - 1;
+}
+
+void PostingList::Cursor::LoadBlock(size_t block) {
+    block_ = block;
+    shallow_block_ = std::max(shallow_block_, block);
+    position_ = 0;
+    if (block < postings_->GetBlockCount()) {
+        block_size_ = postings_->DecodeBlock(block, buffer_);
+        ordinal_ = buffer_.ordinals[0];
+    }
+    else {
+        block_size_ = 0;
+        ordinal_ = END;
+    }
+}
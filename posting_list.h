@@ -0,0 +1,152 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+class SnapshotReader;
+class SnapshotWriter;
+
+// Postings of one term: internal document ordinals in ascending order with the
+// number of occurrences of the term in each document. Postings are grouped into
+// blocks of BLOCK_SIZE; inside a block ordinals are delta-encoded and both
+// deltas and counts are stored as varints, which usually takes 2 bytes per posting.
+// Every block and the whole list also remember the maximum TF of their postings,
+// which bounds the score a document can get from the term.
+// A list loaded from a snapshot reads its blocks straight from the mapped file and
+// copies them to the heap only when it is modified.
+class PostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+
+    class Cursor;
+
+    // Decoded contents of one block
+    struct Buffer {
+        int ordinals[BLOCK_SIZE];
+        uint32_t counts[BLOCK_SIZE];
+    };
+
+    // ordinal must be greater than every ordinal already in the list
+    void Append(int ordinal, uint32_t count, double term_freq);
+
+    bool Contains(int ordinal) const;
+
+    size_t size() const;
+
+    size_t GetBlockCount() const;
+
+    double GetMaxTermFreq() const;
+
+    // Returns the number of postings written to buffer
+    size_t DecodeBlock(size_t block_index, Buffer& buffer) const;
+
+    template <typename Function>
+    void ForEach(Function function) const;
+
+    // Heap memory only, mapped blocks are not counted
+    size_t GetMemoryUsage() const;
+
+    void Save(SnapshotWriter& writer) const;
+
+    // The returned list views the mapped file of the reader
+    static PostingList Load(SnapshotReader& reader);
+
+private:
+    struct Block {
+        int first_ordinal;
+        int last_ordinal;
+        uint32_t offset;
+        uint32_t size;
+        double max_term_freq;
+    };
+
+    std::vector<Block> blocks_;
+    std::vector<uint8_t> bytes_;
+    size_t size_ = 0;
+    double max_term_freq_ = 0.0;
+    bool is_mapped_ = false;
+    const Block* mapped_blocks_ = nullptr;
+    size_t mapped_block_count_ = 0;
+    const uint8_t* mapped_bytes_ = nullptr;
+    size_t mapped_byte_count_ = 0;
+
+    // Mapped or owned storage, whichever is current
+    const Block* GetBlocks() const;
+    const uint8_t* GetBytes() const;
+    size_t GetByteCount() const;
+
+    // Copies mapped storage to the heap before the first modification
+    void MakeOwned();
+
+    // Index of the only block that may hold the ordinal, blocks_.size() if none
+    size_t FindBlock(int ordinal) const;
+};
+
+// Forward iterator over the postings for document-at-a-time evaluation. Besides
+// the current posting it keeps a shallow position: the block that may contain a
+// given ordinal, which can be inspected without decoding it.
+class PostingList::Cursor {
+public:
+    static constexpr int END = std::numeric_limits<int>::max();
+
+    explicit Cursor(const PostingList& postings);
+
+    // END once the postings are exhausted
+    int GetOrdinal() const;
+
+    uint32_t GetCount() const;
+
+    void Next();
+
+    // Moves to the first posting with an ordinal not less than target
+    void NextGeq(int target);
+
+    // Moves the shallow position to the block that may contain target
+    void ShallowSeek(int target);
+
+    double GetBlockMaxTermFreq() const;
+
+    // Last ordinal covered by the shallow block
+    int GetBlockLastOrdinal() const;
+
+private:
+    const PostingList* postings_;
+    size_t block_ = 0;
+    size_t block_size_ = 0;
+    size_t position_ = 0;
+    size_t shallow_block_ = 0;
+    int ordinal_ = END;
+    Buffer buffer_;
+
+    void LoadBlock(size_t block);
+};
+
+// inline, they run once per posting in the evaluation loops
+inline int PostingList::Cursor::GetOrdinal() const {
+    return ordinal_;
+}
+
+inline uint32_t PostingList::Cursor::GetCount() const {
+    return buffer_.counts[position_];
+}
+
+inline void PostingList::Cursor::Next() {
+    if (++position_ < block_size_) {
+        ordinal_ = buffer_.ordinals[position_];
+    }
+    else {
+        LoadBlock(block_ + 1);
+    }
+}
+
+template <typename Function>
+void PostingList::ForEach(Function function) const {
+    Buffer buffer;
+    for (size_t block = 0; block < GetBlockCount(); ++block) {
+        const size_t count = DecodeBlock(block, buffer);
+        for (size_t i = 0; i < count; ++i) {
+            function(buffer.ordinals[i], buffer.counts[i]);
+        }
+    }
+}
@@ -3,32 +3,21 @@
 
 std::vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries)
 {
-   
+    // results go straight into the flat vector, no intermediate vector per query
     std::vector<Document> output_1;
-    std::vector<std::vector<Document>> output(queries.size());
-    std::transform(execution::par,
-        queries.begin(), queries.end(),
-        output.begin(),
-        [&search_server](const auto query)
-        {return search_server.FindTopDocuments(execution::par, query); });
-    for (const auto& query : output) {
-        
-        output_1.insert(output_1.end(), query.begin(), query.end());
-    
-    }
+    ProcessQueriesJoinedStream(search_server, queries.begin(), queries.end(), std::back_inserter(output_1));
     return output_1;
 }
 
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries)
 {
-    std::vector<Document> output_1;
+    METRICS_TIME_PHASE(PROCESS_QUERIES);
     std::vector<std::vector<Document>> output(queries.size());
-    std::transform(execution::par,
-        queries.begin(), queries.end(),
-        output.begin(),
-        [&search_server](const auto query)
-        {return search_server.FindTopDocuments(execution::par, query); });
-
+    // queries and the chunks of every query share the pool, nested tasks do not add threads
+    ThreadPool::GetDefault().ParallelFor(queries.size(),
+        [&](const size_t i)
+        {output[i] = search_server.FindTopDocuments(execution::par, queries[i]); });
+    METRICS_ADD(QUERIES_PROCESSED, queries.size());
 
 
     return output;
@@ -2,6 +2,8 @@
 #include "search_server.h"
 #include <functional>
 #include <execution>
+#include <deque>
+#include <istream>
 #include <list>
 
 
@@ -11,4 +13,96 @@ std::vector<Document> ProcessQueriesJoined(
 
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries);
\ No newline at end of file
+    const std::vector<std::string>& queries);
+
+// Streaming versions for batches that do not fit in memory. Queries are read from
+// [first, last) one at a time and evaluated on the default pool; at most max_in_flight
+// of them are read but not yet emitted (0 picks a window of a few queries per thread).
+// sink(std::vector<Document>&&) is called on the calling thread in the input order.
+// An exception thrown by a query is rethrown after the queries in flight are finished.
+template <typename InputIt, typename Sink>
+void ProcessQueriesStream(const SearchServer& search_server, InputIt first, InputIt last,
+    Sink sink, size_t max_in_flight = 0);
+
+// One query per line
+template <typename Sink>
+void ProcessQueriesStream(const SearchServer& search_server, std::istream& input,
+    Sink sink, size_t max_in_flight = 0);
+
+// Writes the documents of every query to out, in the order of ProcessQueriesJoined
+template <typename InputIt, typename OutputIt>
+OutputIt ProcessQueriesJoinedStream(const SearchServer& search_server, InputIt first, InputIt last,
+    OutputIt out, size_t max_in_flight = 0);
+
+namespace process_queries_detail {
+
+    template <typename NextQuery, typename Sink>
+    void RunQueryWindow(const SearchServer& search_server, NextQuery next_query, Sink& sink, size_t max_in_flight) {
+        METRICS_TIME_PHASE(PROCESS_QUERIES);
+        auto& pool = ThreadPool::GetDefault();
+        if (max_in_flight == 0) {
+            max_in_flight = pool.GetThreadCount() * 4;
+        }
+        std::deque<std::future<std::vector<Document>>> in_flight;
+        const auto emit_front = [&] {
+            auto future = std::move(in_flight.front());
+            in_flight.pop_front();
+            pool.Wait(future);
+            sink(future.get());
+        };
+        try {
+            std::string query;
+            while (next_query(query)) {
+                // the window already runs queries in parallel, splitting each of them would only add overhead
+                in_flight.push_back(pool.Submit([&search_server, query = std::move(query)] {
+                    return search_server.FindTopDocuments(std::execution::seq, query);
+                }));
+                query = {};
+                METRICS_ADD(QUERIES_PROCESSED, 1);
+                if (in_flight.size() >= max_in_flight) {
+                    emit_front();
+                }
+            }
+            while (!in_flight.empty()) {
+                emit_front();
+            }
+        }
+        catch (...) {
+            for (const auto& future : in_flight) {
+                pool.Wait(future);
+            }
+            throw;
+        }
+    }
+
+} // namespace process_queries_detail
+
+template <typename InputIt, typename Sink>
+void ProcessQueriesStream(const SearchServer& search_server, InputIt first, InputIt last,
+    Sink sink, size_t max_in_flight) {
+    process_queries_detail::RunQueryWindow(search_server, [&first, &last](std::string& query) {
+        if (first == last) {
+            return false;
+        }
+        query = *first;
+        ++first;
+        return true;
+    }, sink, max_in_flight);
+}
+
+template <typename Sink>
+void ProcessQueriesStream(const SearchServer& search_server, std::istream& input,
+    Sink sink, size_t max_in_flight) {
+    process_queries_detail::RunQueryWindow(search_server, [&input](std::string& query) {
+        return static_cast<bool>(std::getline(input, query));
+    }, sink, max_in_flight);
+}
+
+template <typename InputIt, typename OutputIt>
+OutputIt ProcessQueriesJoinedStream(const SearchServer& search_server, InputIt first, InputIt last,
+    OutputIt out, size_t max_in_flight) {
+    ProcessQueriesStream(search_server, first, last, [&out](std::vector<Document>&& documents) {
+        out = std::move(documents.begin(), documents.end(), out);
+    }, max_in_flight);
+    return out;
+}
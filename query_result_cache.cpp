@@ -0,0 +1,103 @@
+#include "query_result_cache.h"
+
+#include <functional>
+
+QueryResultCache::QueryResultCache(const SearchServer& search_server, size_t memory_budget, size_t shard_count)
+    : search_server_(search_server)
+    , shard_memory_budget_(shard_count == 0 ? 0 : memory_budget / shard_count)
+    , shards_(shard_count)
+{
+    if (shard_count == 0) {
+        throw invalid_argument("Shard count must be positive"s);
+    }
+}
+
+vector<Document> QueryResultCache::FindTopDocuments(const std::string_view raw_query, DocumentStatus status, size_t top_k) {
+    string key = search_server_.GetQueryKey(raw_query);
+    key += to_string(static_cast<int>(status));
+    key += '/';
+    key += to_string(top_k);
+    auto& shard = shards_[std::hash<std::string>{}(key) % shards_.size()];
+    const uint64_t generation = search_server_.GetGeneration();
+    {
+        std::lock_guard guard(shard.mutex);
+        Validate(shard, generation);
+        const auto it = shard.entry_by_key.find(key);
+        if (it != shard.entry_by_key.end()) {
+            ++shard.statistics.hits;
+            METRICS_ADD(CACHE_HITS, 1);
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            return it->second->documents;
+        }
+        ++shard.statistics.misses;
+        METRICS_ADD(CACHE_MISSES, 1);
+    }
+
+    // evaluated without the lock, so a slow query does not hold up the other queries
+    // of the shard; concurrent misses of one query evaluate it more than once
+    auto documents = search_server_.FindTopDocuments(raw_query, status, top_k);
+    Entry entry{ move(key), documents };
+    entry.memory_usage = ComputeMemoryUsage(entry);
+    if (entry.memory_usage > shard_memory_budget_) {
+        return documents;
+    }
+
+    std::lock_guard guard(shard.mutex);
+    Validate(shard, generation);
+    if (shard.generation != generation || shard.entry_by_key.count(entry.key) > 0) {
+        return documents;
+    }
+    while (shard.memory_usage + entry.memory_usage > shard_memory_budget_) {
+        shard.memory_usage -= shard.entries.back().memory_usage;
+        shard.entry_by_key.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+        ++shard.statistics.evictions;
+    }
+    shard.memory_usage += entry.memory_usage;
+    shard.entries.push_front(move(entry));
+    shard.entry_by_key.emplace(shard.entries.front().key, shard.entries.begin());
+    return documents;
+}
+
+QueryResultCache::Statistics QueryResultCache::GetStatistics() const {
+    Statistics statistics;
+    for (const auto& shard : shards_) {
+        std::lock_guard guard(shard.mutex);
+        statistics.hits += shard.statistics.hits;
+        statistics.misses += shard.statistics.misses;
+        statistics.evictions += shard.statistics.evictions;
+        statistics.invalidations += shard.statistics.invalidations;
+        statistics.entry_count += shard.entries.size();
+        statistics.memory_usage += shard.memory_usage;
+    }
+    return statistics;
+}
+
+void QueryResultCache::Clear() {
+    for (auto& shard : shards_) {
+        std::lock_guard guard(shard.mutex);
+        shard.entry_by_key.clear();
+        shard.entries.clear();
+        shard.memory_usage = 0;
+    }
+}
+
+void QueryResultCache::Validate(Shard& shard, uint64_t generation) {
+    if (shard.generation == generation) {
+        return;
+    }
+    if (generation < shard.generation) {
+        return; // a query that started before the index changed
+    }
+    shard.statistics.invalidations += shard.entries.size();
+    shard.entry_by_key.clear();
+    shard.entries.clear();
+    shard.memory_usage = 0;
+    shard.generation = generation;
+}
+
+size_t QueryResultCache::ComputeMemoryUsage(const Entry& entry) {
+    // the list node, the hash table node and the heap blocks of the key and the documents
+    constexpr size_t NODE_OVERHEAD = sizeof(Entry) + 2 * sizeof(void*) + sizeof(std::string_view) + 4 * sizeof(void*);
+    return NODE_OVERHEAD + entry.key.capacity() + entry.documents.capacity() * sizeof(Document);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// Keeps the results of FindTopDocuments for repeated queries. Queries are keyed by
+// SearchServer::GetQueryKey, the status and top_k, so "cat -dog cat" and "-dog cat"
+// share an entry. An entry is valid only for the index generation it was found at:
+// adding or removing a document drops every entry. The cache is split into shards,
+// each an LRU list under its own mutex with an equal part of the memory budget.
+// Thread safe, as long as the index is not modified while queries run.
+class QueryResultCache {
+public:
+    static constexpr size_t DEFAULT_SHARD_COUNT = 16;
+
+    struct Statistics {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;      // entries dropped to stay within the budget
+        uint64_t invalidations = 0;  // entries dropped because the index changed
+        size_t entry_count = 0;
+        size_t memory_usage = 0;     // approximate bytes held by the entries
+    };
+
+    QueryResultCache(const SearchServer& search_server, size_t memory_budget,
+        size_t shard_count = DEFAULT_SHARD_COUNT);
+
+    vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+        size_t top_k = MAX_RESULT_DOCUMENT_COUNT);
+
+    Statistics GetStatistics() const;
+
+    void Clear();
+
+private:
+    struct Entry {
+        std::string key;
+        vector<Document> documents;
+        size_t memory_usage = 0;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> entries; // most recently used first
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> entry_by_key; // views the keys of entries
+        uint64_t generation = 0;
+        size_t memory_usage = 0;
+        Statistics statistics;
+    };
+
+    const SearchServer& search_server_;
+    const size_t shard_memory_budget_;
+    std::vector<Shard> shards_;
+
+    // Drops every entry if the index changed since they were found
+    void Validate(Shard& shard, uint64_t generation);
+
+    static size_t ComputeMemoryUsage(const Entry& entry);
+};
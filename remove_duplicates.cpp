@@ -1,26 +1,211 @@
 #include "remove_duplicates.h"
 
-void RemoveDuplicates(SearchServer& search_server)
-{
-	std::vector<int> ids_; //����� ��� id, ������� ����� ����� �������, ��� ��� � ������ ����� �������� �������� � ��������� ����������� �����
-	std::set<std::set<std::string>> id_words;
-	std::set<std::string> words;
-
-	for (const auto& id_1 : search_server) {
-	
-		for (const auto& c : search_server.GetWordFrequencies(id_1)) {
-			words.insert(string(c.first));
-		}
-		if (!id_words.count(words)) {
-			id_words.insert(words);
-		}
-		else {
-			cout << "Found duplicate document id " << id_1 << endl;
-			ids_.push_back(id_1);
-		}
-		words.clear();
-	}
-	for (const auto& id : ids_) {
-		search_server.RemoveDocument(id);
-	}
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+
+uint64_t MixBits(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+struct Fingerprint {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    bool operator==(const Fingerprint& other) const {
+        return high == other.high && low == other.low;
+    }
+};
+
+struct FingerprintHasher {
+    size_t operator()(const Fingerprint& fingerprint) const {
+        return static_cast<size_t>(fingerprint.low);
+    }
+};
+
+// The sorted term ids of one document
+struct TermIdRange {
+    const int* first = nullptr;
+    const int* last = nullptr;
+
+    const int* begin() const {
+        return first;
+    }
+
+    const int* end() const {
+        return last;
+    }
+
+    size_t size() const {
+        return static_cast<size_t>(last - first);
+    }
+};
+
+TermIdRange GetTermIds(const SearchServer::DocumentTermIds& documents, size_t index) {
+    return { documents.term_ids.data() + documents.offsets[index], documents.term_ids.data() + documents.offsets[index + 1] };
+}
+
+// Two independently seeded hash chains over the sorted term ids
+Fingerprint ComputeFingerprint(TermIdRange term_ids) {
+    Fingerprint fingerprint{ 0x9E3779B97F4A7C15ull, 0xD6E8FEB86659FD93ull };
+    for (const int term_id : term_ids) {
+        const uint64_t value = static_cast<uint32_t>(term_id);
+        fingerprint.high = MixBits(fingerprint.high ^ (value + 0x632BE59BD9B4E019ull));
+        fingerprint.low = MixBits((fingerprint.low + value) * 0x8CB92BA72F3D8DD7ull);
+    }
+    fingerprint.high ^= MixBits(term_ids.size());
+    return fingerprint;
+}
+
+constexpr size_t MIN_HASH_COUNT = 128;
+
+using MinHashSignature = std::array<uint32_t, MIN_HASH_COUNT>;
+
+// The i-th hash of a term is h1 + i * h2, so a term is mixed once for all of them
+MinHashSignature ComputeMinHashSignature(TermIdRange term_ids) {
+    MinHashSignature signature;
+    signature.fill(UINT32_MAX);
+    for (const int term_id : term_ids) {
+        const uint64_t hash = MixBits(static_cast<uint32_t>(term_id) + 0x2545F4914F6CDD1Dull);
+        const uint32_t first = static_cast<uint32_t>(hash);
+        const uint32_t step = static_cast<uint32_t>(hash >> 32) | 1;
+        for (size_t i = 0; i < MIN_HASH_COUNT; ++i) {
+            signature[i] = min(signature[i], first + static_cast<uint32_t>(i) * step);
+        }
+    }
+    return signature;
+}
+
+// A pair with similarity s shares one of b bands of r hashes with probability
+// 1 - (1 - s^r)^b, which steps up around s = (1/b)^(1/r). The longest bands with the
+// step below the threshold give the fewest false candidates at a high recall
+size_t ChooseBandRows(double min_similarity) {
+    size_t band_rows = 1;
+    for (size_t rows = 1; rows <= MIN_HASH_COUNT; rows *= 2) {
+        const double band_count = static_cast<double>(MIN_HASH_COUNT / rows);
+        if (pow(1.0 / band_count, 1.0 / rows) <= min_similarity) {
+            band_rows = rows;
+        }
+    }
+    return band_rows;
+}
+
+double ComputeJaccardSimilarity(TermIdRange lhs, TermIdRange rhs) {
+    if (lhs.size() == 0 && rhs.size() == 0) {
+        return 1.0;
+    }
+    size_t intersection_size = 0;
+    for (auto left = lhs.begin(), right = rhs.begin(); left != lhs.end() && right != rhs.end();) {
+        if (*left < *right) {
+            ++left;
+        }
+        else if (*right < *left) {
+            ++right;
+        }
+        else {
+            ++intersection_size;
+            ++left;
+            ++right;
+        }
+    }
+    return static_cast<double>(intersection_size) / (lhs.size() + rhs.size() - intersection_size);
+}
+
+void RemoveFoundDuplicates(SearchServer& search_server, const vector<int>& duplicate_ids) {
+    for (const int document_id : duplicate_ids) {
+        cout << "Found duplicate document id "s << document_id << endl;
+    }
+    for (const int document_id : duplicate_ids) {
+        search_server.RemoveDocument(document_id);
+    }
+    search_server.PurgeRemovedDocuments();
+}
+
+}  // namespace
+
+void RemoveDuplicates(SearchServer& search_server) {
+    const auto documents = search_server.GetDocumentTermIds();
+    const auto& document_ids = documents.document_ids;
+    vector<Fingerprint> fingerprints(document_ids.size());
+    ThreadPool::GetDefault().ParallelFor(document_ids.size(), [&](size_t index) {
+        fingerprints[index] = ComputeFingerprint(GetTermIds(documents, index));
+    });
+
+    // a fingerprint maps to several kept documents only if different word sets collide
+    std::unordered_multimap<Fingerprint, size_t, FingerprintHasher> kept_documents;
+    kept_documents.reserve(document_ids.size());
+    vector<int> duplicate_ids;
+    for (size_t index = 0; index < document_ids.size(); ++index) {
+        const auto [first, last] = kept_documents.equal_range(fingerprints[index]);
+        const auto term_ids = GetTermIds(documents, index);
+        const bool is_duplicate = any_of(first, last, [&](const auto& kept) {
+            const auto kept_term_ids = GetTermIds(documents, kept.second);
+            return equal(term_ids.begin(), term_ids.end(), kept_term_ids.begin(), kept_term_ids.end());
+        });
+        if (is_duplicate) {
+            duplicate_ids.push_back(document_ids[index]);
+        }
+        else {
+            kept_documents.emplace(fingerprints[index], index);
+        }
+    }
+    RemoveFoundDuplicates(search_server, duplicate_ids);
+}
+
+void RemoveNearDuplicates(SearchServer& search_server, double min_similarity) {
+    if (!(min_similarity > 0.0 && min_similarity <= 1.0)) {
+        throw invalid_argument("Similarity threshold must be in (0, 1]"s);
+    }
+    const auto documents = search_server.GetDocumentTermIds();
+    const auto& document_ids = documents.document_ids;
+    vector<MinHashSignature> signatures(document_ids.size());
+    ThreadPool::GetDefault().ParallelFor(document_ids.size(), [&](size_t index) {
+        signatures[index] = ComputeMinHashSignature(GetTermIds(documents, index));
+    });
+
+    const size_t band_rows = ChooseBandRows(min_similarity);
+    const size_t band_count = MIN_HASH_COUNT / band_rows;
+    const auto get_band_key = [&](size_t index, size_t band) {
+        uint64_t key = band;
+        for (size_t row = band * band_rows; row < (band + 1) * band_rows; ++row) {
+            key = MixBits(key ^ signatures[index][row]) + row;
+        }
+        return key;
+    };
+
+    // kept documents by the keys of their bands
+    vector<std::unordered_map<uint64_t, vector<size_t>>> band_buckets(band_count);
+    vector<size_t> candidates;
+    vector<int> duplicate_ids;
+    for (size_t index = 0; index < document_ids.size(); ++index) {
+        candidates.clear();
+        for (size_t band = 0; band < band_count; ++band) {
+            const auto bucket = band_buckets[band].find(get_band_key(index, band));
+            if (bucket != band_buckets[band].end()) {
+                candidates.insert(candidates.end(), bucket->second.begin(), bucket->second.end());
+            }
+        }
+        sort(candidates.begin(), candidates.end());
+        candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+        const bool is_duplicate = any_of(candidates.begin(), candidates.end(), [&](size_t kept) {
+            return ComputeJaccardSimilarity(GetTermIds(documents, index), GetTermIds(documents, kept)) >= min_similarity;
+        });
+        if (is_duplicate) {
+            duplicate_ids.push_back(document_ids[index]);
+            continue;
+        }
+        for (size_t band = 0; band < band_count; ++band) {
+            band_buckets[band][get_band_key(index, band)].push_back(index);
+        }
+    }
+    RemoveFoundDuplicates(search_server, duplicate_ids);
 }
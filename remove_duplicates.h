@@ -1,4 +1,16 @@
 #pragma once
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
+// Removes every document with the same set of distinct words as a document with a
+// smaller id and prints "Found duplicate document id <id>" for each, in id order.
+// Documents are compared by 128-bit fingerprints of their term id sets, computed in
+// parallel; the word sets themselves are compared only when fingerprints match.
+void RemoveDuplicates(SearchServer& search_server);
+
+// Like RemoveDuplicates for near duplicates: a document is removed if the Jaccard
+// similarity of its word set and the one of a kept document with a smaller id is at
+// least min_similarity, which has to be in (0, 1]. Candidates are found by
+// locality-sensitive hashing of MinHash signatures and their similarity is then
+// computed exactly, so no dissimilar document is removed, while a similar pair is
+// missed with a small probability.
+void RemoveNearDuplicates(SearchServer& search_server, double min_similarity);
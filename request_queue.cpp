@@ -1,51 +1,204 @@
 #include "request_queue.h"
 
-RequestQueue::RequestQueue(const SearchServer& search_server) :search_server_(search_server) {
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+constexpr int RECORD_LATENCY_BITS = 5;
+constexpr int RECORD_SEQUENCE_SHIFT = RECORD_LATENCY_BITS + 1;
+constexpr uint64_t RECORD_HAS_RESULTS = uint64_t(1) << RECORD_LATENCY_BITS;
+constexpr uint64_t RECORD_LATENCY_MASK = RECORD_HAS_RESULTS - 1;
+
+static_assert(RequestQueue::LatencyHistogram::BUCKET_COUNT == uint64_t(1) << RECORD_LATENCY_BITS);
+
+size_t GetLatencyBucket(RequestQueue::Clock::duration latency) {
+    auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    size_t bucket = 0;
+    while (microseconds > 0 && bucket + 1 < RequestQueue::LatencyHistogram::BUCKET_COUNT) {
+        microseconds >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+}  // namespace
+
+uint64_t RequestQueue::LatencyHistogram::GetTotalCount() const {
+    uint64_t total_count = 0;
+    for (const uint64_t count : counts) {
+        total_count += count;
+    }
+    return total_count;
 }
 
-vector<Document> RequestQueue::AddFindRequest(const string& raw_query, DocumentStatus status) {
-    vector<Document> queries_documents = search_server_.FindTopDocuments(raw_query, status);
-    DequeWork(queries_documents);
-    return queries_documents;
+uint64_t RequestQueue::LatencyHistogram::GetPercentile(double fraction) const {
+    const uint64_t total_count = GetTotalCount();
+    uint64_t count = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        count += counts[bucket];
+        if (count > 0 && count >= fraction * total_count) {
+            return uint64_t(1) << bucket;
+        }
+    }
+    return 0;
+}
 
+void RequestQueue::WindowCounters::Add(bool has_results, size_t latency_bucket, int64_t delta) {
+    request_count.fetch_add(delta, std::memory_order_relaxed);
+    if (!has_results) {
+        no_result_count.fetch_add(delta, std::memory_order_relaxed);
+    }
+    latency_counts[latency_bucket].fetch_add(delta, std::memory_order_relaxed);
 }
-vector<Document> RequestQueue::AddFindRequest(const string& raw_query) {
-    vector<Document> queries_documents = search_server_.FindTopDocuments(raw_query);
-    DequeWork(queries_documents);
-    return queries_documents;
+
+void RequestQueue::WindowCounters::Reset() {
+    request_count.store(0, std::memory_order_relaxed);
+    no_result_count.store(0, std::memory_order_relaxed);
+    for (auto& count : latency_counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
 }
 
-void RequestQueue::DequeWork(const vector<Document>& queries_documents) {
-    if (queries_documents.size() == 0 && queries_results.number_query < min_in_day_) {
-        queries_results.number_query++;
-        queries_results.result = false;
-        requests_.push_back(queries_results);
+RequestQueue::RequestQueue(const SearchServer& search_server, size_t window_request_count)
+    : search_server_(search_server)
+    , slots_(std::make_unique<std::atomic<uint64_t>[]>(window_request_count))
+    , slot_count_(window_request_count)
+{
+    if (window_request_count == 0) {
+        throw std::invalid_argument("Request window must be positive"s);
     }
-    else if (queries_documents.size() != 0 && queries_results.number_query < min_in_day_) {
-        queries_results.number_query++;
-        queries_results.result = true;
-        requests_.push_back(queries_results);
+}
+
+RequestQueue::RequestQueue(const SearchServer& search_server, Clock::duration window_duration, size_t bucket_count)
+    : search_server_(search_server)
+    , buckets_(std::make_unique<TimeBucket[]>(bucket_count))
+    , bucket_count_(bucket_count)
+    , start_time_(Clock::now())
+{
+    if (bucket_count == 0 || window_duration < Clock::duration(bucket_count)) {
+        throw std::invalid_argument("Request window must be positive"s);
     }
-    else if (queries_documents.size() == 0) {
-        requests_.pop_front();
-        queries_results.number_query--;
-        queries_results.result = false;
-        requests_.push_back(queries_results);
+    bucket_duration_ = window_duration / bucket_count;
+}
+
+std::vector<Document> RequestQueue::AddFindRequest(const std::string_view raw_query, DocumentStatus status) {
+    return AddFindRequest(raw_query, DocumentStatusPredicate{ status });
+}
+
+std::vector<Document> RequestQueue::AddFindRequest(const std::string_view raw_query) {
+    return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
+}
+
+void RequestQueue::RecordRequest(size_t result_count, Clock::duration latency) {
+    if (slots_) {
+        RecordInCountWindow(result_count > 0, GetLatencyBucket(latency));
     }
-    else if (queries_documents.size() != 0) {
-        requests_.pop_front();
-        queries_results.number_query--;
-        queries_results.result = true;
-        requests_.push_back(queries_results);
+    else {
+        RecordInTimeWindow(result_count > 0, GetLatencyBucket(latency));
     }
 }
 
 int RequestQueue::GetNoResultRequests() const {
-    int i = 0;
-    for (auto it = requests_.begin(); it != requests_.end(); ++it) {
-        if ((*it).result == 0) {
-            i++;
+    if (slots_) {
+        return static_cast<int>(totals_.no_result_count.load(std::memory_order_relaxed));
+    }
+    int64_t no_result_count = 0;
+    ForEachLiveBucket([&](const WindowCounters& counters) {
+        no_result_count += counters.no_result_count.load(std::memory_order_relaxed);
+    });
+    return static_cast<int>(no_result_count);
+}
+
+int RequestQueue::GetRequestCount() const {
+    if (slots_) {
+        return static_cast<int>(totals_.request_count.load(std::memory_order_relaxed));
+    }
+    int64_t request_count = 0;
+    ForEachLiveBucket([&](const WindowCounters& counters) {
+        request_count += counters.request_count.load(std::memory_order_relaxed);
+    });
+    return static_cast<int>(request_count);
+}
+
+RequestQueue::LatencyHistogram RequestQueue::GetLatencyHistogram() const {
+    std::array<int64_t, LatencyHistogram::BUCKET_COUNT> counts{};
+    const auto add_counts = [&](const WindowCounters& counters) {
+        for (size_t bucket = 0; bucket < counts.size(); ++bucket) {
+            counts[bucket] += counters.latency_counts[bucket].load(std::memory_order_relaxed);
+        }
+    };
+    if (slots_) {
+        add_counts(totals_);
+    }
+    else {
+        ForEachLiveBucket(add_counts);
+    }
+    // a count read while a record moves out of the window may be briefly negative
+    LatencyHistogram histogram;
+    for (size_t bucket = 0; bucket < counts.size(); ++bucket) {
+        histogram.counts[bucket] = static_cast<uint64_t>(std::max<int64_t>(counts[bucket], 0));
+    }
+    return histogram;
+}
+
+void RequestQueue::RecordInCountWindow(bool has_results, size_t latency_bucket) {
+    const uint64_t sequence = next_sequence_.fetch_add(1, std::memory_order_relaxed);
+    const uint64_t record = ((sequence + 1) << RECORD_SEQUENCE_SHIFT) | (has_results ? RECORD_HAS_RESULTS : 0) | latency_bucket;
+    // counted before it is published, so the producer that pushes it out never subtracts it first
+    totals_.Add(has_results, latency_bucket, 1);
+    auto& slot = slots_[sequence % slot_count_];
+    uint64_t replaced = slot.load(std::memory_order_relaxed);
+    do {
+        if (replaced > record) {
+            // a producer that was faster already stored a request a whole window newer
+            totals_.Add(has_results, latency_bucket, -1);
+            return;
+        }
+    } while (!slot.compare_exchange_weak(replaced, record, std::memory_order_acq_rel, std::memory_order_relaxed));
+    if (replaced != 0) {
+        totals_.Add((replaced & RECORD_HAS_RESULTS) != 0, replaced & RECORD_LATENCY_MASK, -1);
+    }
+}
+
+void RequestQueue::RecordInTimeWindow(bool has_results, size_t latency_bucket) {
+    const int64_t epoch = GetCurrentEpoch();
+    auto& bucket = buckets_[epoch % bucket_count_];
+    int64_t bucket_epoch = bucket.epoch.load(std::memory_order_acquire);
+    while (bucket_epoch != epoch) {
+        if (bucket_epoch > epoch) {
+            // the clock was read before a stall longer than the window, the request has expired
+            return;
+        }
+        if (bucket_epoch == RESETTING_EPOCH) {
+            std::this_thread::yield();
+            bucket_epoch = bucket.epoch.load(std::memory_order_acquire);
+            continue;
+        }
+        // the bucket holds an expired interval, the producer that claims it clears it.
+        // A producer that checked the old epoch just before may still add its request,
+        // which then counts in the new interval.
+        if (bucket.epoch.compare_exchange_weak(bucket_epoch, RESETTING_EPOCH, std::memory_order_acquire)) {
+            bucket.counters.Reset();
+            bucket.epoch.store(epoch, std::memory_order_release);
+            bucket_epoch = epoch;
+        }
+    }
+    bucket.counters.Add(has_results, latency_bucket, 1);
+}
+
+int64_t RequestQueue::GetCurrentEpoch() const {
+    return (Clock::now() - start_time_) / bucket_duration_;
+}
+
+template <typename Function>
+void RequestQueue::ForEachLiveBucket(Function function) const {
+    const int64_t oldest_epoch = GetCurrentEpoch() - static_cast<int64_t>(bucket_count_) + 1;
+    for (size_t i = 0; i < bucket_count_; ++i) {
+        const auto& bucket = buckets_[i];
+        if (bucket.epoch.load(std::memory_order_acquire) >= oldest_epoch) {
+            function(bucket.counters);
         }
     }
-    return i;
 }
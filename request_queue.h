@@ -1,35 +1,109 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
 #include "search_server.h"
-#include <deque>
 
+// Statistics of the latest search requests, safe to record from any number of
+// threads at once without locks. The window holds either the last
+// window_request_count requests or the requests of the last window_duration.
+// Counters of the window are kept up to date by the producers, so reading them
+// costs the same whatever the window size.
 class RequestQueue {
 public:
-    explicit RequestQueue(const SearchServer& search_server);
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t MIN_IN_DAY = 1440;
+    static constexpr size_t DEFAULT_TIME_BUCKET_COUNT = 60;
+
+    // Bucket 0 counts requests faster than a microsecond, bucket i > 0 the ones that
+    // took [2^(i-1), 2^i) microseconds, the last bucket everything slower
+    struct LatencyHistogram {
+        static constexpr size_t BUCKET_COUNT = 32;
+
+        std::array<uint64_t, BUCKET_COUNT> counts{};
+
+        uint64_t GetTotalCount() const;
+
+        // Upper bound in microseconds of the bucket reached by the given fraction of requests
+        uint64_t GetPercentile(double fraction) const;
+    };
+
+    explicit RequestQueue(const SearchServer& search_server, size_t window_request_count = MIN_IN_DAY);
+
+    // The window moves in steps of window_duration / bucket_count
+    RequestQueue(const SearchServer& search_server, Clock::duration window_duration,
+        size_t bucket_count = DEFAULT_TIME_BUCKET_COUNT);
+
     // сделаем "обёртки" для всех методов поиска, чтобы сохранять результаты для нашей статистики
     template <typename DocumentPredicate>
-    vector<Document> AddFindRequest(const string& raw_query, DocumentPredicate document_predicate);
-    vector<Document> AddFindRequest(const string& raw_query, DocumentStatus status);
-    vector<Document> AddFindRequest(const string& raw_query);
+    std::vector<Document> AddFindRequest(const std::string_view raw_query, DocumentPredicate document_predicate);
+    std::vector<Document> AddFindRequest(const std::string_view raw_query, DocumentStatus status);
+    std::vector<Document> AddFindRequest(const std::string_view raw_query);
 
-    void DequeWork(const vector<Document>& queries_documents);
+    // Records a request that was served elsewhere
+    void RecordRequest(size_t result_count, Clock::duration latency);
 
     int GetNoResultRequests() const;
+
+    int GetRequestCount() const;
+
+    LatencyHistogram GetLatencyHistogram() const;
+
 private:
-    struct QueryResult {
-        bool result = false; // состояние запроса 1: запрос не нулевой 0:запрос нулевой
-        int number_query = 1;// определите, что должно быть в структуре
+    struct WindowCounters {
+        std::atomic<int64_t> request_count{ 0 };
+        std::atomic<int64_t> no_result_count{ 0 };
+        std::array<std::atomic<int64_t>, LatencyHistogram::BUCKET_COUNT> latency_counts{};
+
+        void Add(bool has_results, size_t latency_bucket, int64_t delta);
+
+        void Reset();
+    };
+
+    struct TimeBucket {
+        std::atomic<int64_t> epoch{ EMPTY_EPOCH };
+        WindowCounters counters;
     };
-    QueryResult queries_results;
-    deque<QueryResult> requests_;
-    const static int min_in_day_ = 1440;
+
+    static constexpr int64_t EMPTY_EPOCH = -1;
+    static constexpr int64_t RESETTING_EPOCH = -2;
+
     const SearchServer& search_server_;
-    // возможно, здесь вам понадобится что-то ещё
+
+    // count window: a ring of request records, a record is a sequence number
+    // (plus one, 0 marks a free slot), the has-results flag and the latency bucket
+    std::unique_ptr<std::atomic<uint64_t>[]> slots_;
+    size_t slot_count_ = 0;
+    std::atomic<uint64_t> next_sequence_{ 0 };
+    WindowCounters totals_;
+
+    // time window: a ring of per-interval counters, the interval of the bucket is its epoch
+    std::unique_ptr<TimeBucket[]> buckets_;
+    size_t bucket_count_ = 0;
+    Clock::duration bucket_duration_{};
+    Clock::time_point start_time_;
+
+    void RecordInCountWindow(bool has_results, size_t latency_bucket);
+
+    void RecordInTimeWindow(bool has_results, size_t latency_bucket);
+
+    int64_t GetCurrentEpoch() const;
+
+    // Sums the buckets of the time window
+    template <typename Function>
+    void ForEachLiveBucket(Function function) const;
 };
 
 template <typename DocumentPredicate>
-vector<Document>  RequestQueue::AddFindRequest(const string& raw_query, DocumentPredicate document_predicate) {
-    vector<Document> queries_documents = search_server_.FindTopDocuments(raw_query, document_predicate);
-    DequeWork(queries_documents);
-    return queries_documents;
-
-}
\ No newline at end of file
+std::vector<Document> RequestQueue::AddFindRequest(const std::string_view raw_query, DocumentPredicate document_predicate) {
+    const auto start_time = Clock::now();
+    std::vector<Document> documents = search_server_.FindTopDocuments(raw_query, document_predicate);
+    RecordRequest(documents.size(), Clock::now() - start_time);
+    return documents;
+}
@@ -0,0 +1,18 @@
+#include "score_accumulator.h"
+
+#include <algorithm>
+
+void ScoreAccumulator::Reset(int ordinal_begin, int ordinal_end) {
+    ordinal_begin_ = ordinal_begin;
+    const size_t size = static_cast<size_t>(std::max(0, ordinal_end - ordinal_begin));
+    if (scores_.size() < size) {
+        scores_.resize(size);
+        epochs_.resize(size, epoch_);
+    }
+    touched_.clear();
+    if (++epoch_ == 0) {
+        // the stamps wrapped around, old ones could look current again
+        std::fill(epochs_.begin(), epochs_.end(), 0);
+        epoch_ = 1;
+    }
+}
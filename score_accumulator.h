@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Term-at-a-time score accumulator over a range of document ordinals. Scores live
+// in a flat array indexed by ordinal; an epoch stamp per slot tells which slots
+// belong to the current query, so starting a query clears nothing and the buffers
+// are reused by every query of the owning thread.
+class ScoreAccumulator {
+public:
+    // Starts a new query over ordinals [ordinal_begin, ordinal_end)
+    void Reset(int ordinal_begin, int ordinal_end);
+
+    void Add(int ordinal, double score);
+
+    // Drops the document from the current query
+    void Exclude(int ordinal);
+
+    // function(ordinal, score) for every scored document that was not excluded
+    template <typename Function>
+    void ForEach(Function function) const;
+
+private:
+    static constexpr double EXCLUDED = -std::numeric_limits<double>::infinity();
+
+    int ordinal_begin_ = 0;
+    uint32_t epoch_ = 0;
+    std::vector<double> scores_;
+    std::vector<uint32_t> epochs_;
+    std::vector<int> touched_;
+};
+
+inline void ScoreAccumulator::Add(int ordinal, double score) {
+    const size_t slot = ordinal - ordinal_begin_;
+    if (epochs_[slot] != epoch_) {
+        epochs_[slot] = epoch_;
+        scores_[slot] = score;
+        touched_.push_back(ordinal);
+    }
+    else {
+        scores_[slot] += score;
+    }
+}
+
+inline void ScoreAccumulator::Exclude(int ordinal) {
+    const size_t slot = ordinal - ordinal_begin_;
+    if (epochs_[slot] == epoch_) {
+        scores_[slot] = EXCLUDED;
+    }
+}
+
+template <typename Function>
+void ScoreAccumulator::ForEach(Function function) const {
+    for (const int ordinal : touched_) {
+        const double score = scores_[ordinal - ordinal_begin_];
+        if (score != EXCLUDED) {
+            function(ordinal, score);
+        }
+    }
+}
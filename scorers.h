@@ -0,0 +1,94 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+// Scorer policies of BasicSearchServer. The relevance of a document is the sum, over
+// the plus words it contains, of Score(...) times the IDF of the word. A scorer is
+// prepared from the statistics of the index before the first query after a change
+// and then only read, so Score inlines into the evaluation loops as plain arithmetic.
+// A scorer provides:
+//   static double ComputeInverseDocumentFreq(double document_count, int document_freq);
+//   void Prepare(double average_length);
+//   double Score(uint32_t count, double inv_word_count, uint8_t length_code) const;
+//   double GetUpperBound(double max_term_freq) const;
+// Score gets the count of the word in the document, 1 / document length and the
+// quantized length. GetUpperBound bounds Score over the postings whose
+// count * inv_word_count is at most max_term_freq, it drives the dynamic pruning.
+
+// Document lengths quantized to a byte: exact below 16 words, above that 3 bits of
+// mantissa, so a length is off by less than 12.5%
+inline uint8_t EncodeDocumentLength(uint64_t length) {
+    if (length < 16) {
+        return static_cast<uint8_t>(length);
+    }
+    int shift = 0;
+    while ((length >> shift) >= 16) {
+        ++shift;
+    }
+    const uint64_t code = 8 + shift * 8 + ((length >> shift) - 8);
+    return static_cast<uint8_t>(code > 255 ? 255 : code);
+}
+
+// The greatest length with the code, so a decoded length is never below the real one
+inline uint64_t DecodeDocumentLength(uint8_t code) {
+    if (code < 16) {
+        return code;
+    }
+    const int shift = (code - 8) / 8;
+    const uint64_t mantissa = 8 + (code - 8) % 8;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+// Raw term frequency times log(N / df), the historical ranking of the index
+struct TfIdfScorer {
+    static double ComputeInverseDocumentFreq(double document_count, int document_freq) {
+        return std::log(document_count / document_freq);
+    }
+
+    void Prepare(double) {
+    }
+
+    double Score(uint32_t count, double inv_word_count, uint8_t) const {
+        return count * inv_word_count;
+    }
+
+    double GetUpperBound(double max_term_freq) const {
+        return max_term_freq;
+    }
+};
+
+// Okapi BM25 with the quantized document length
+class Bm25Scorer {
+public:
+    static constexpr double K1 = 1.2;
+    static constexpr double B = 0.75;
+
+    static double ComputeInverseDocumentFreq(double document_count, int document_freq) {
+        return std::log(1.0 + (document_count - document_freq + 0.5) / (document_freq + 0.5));
+    }
+
+    void Prepare(double average_length) {
+        if (!(average_length > 0.0)) {
+            average_length = 1.0;
+        }
+        for (int code = 0; code < 256; ++code) {
+            length_norms_[code] = K1 * (1.0 - B + B * DecodeDocumentLength(static_cast<uint8_t>(code)) / average_length);
+        }
+        bound_norm_ = K1 * B / average_length;
+    }
+
+    double Score(uint32_t count, double, uint8_t length_code) const {
+        return count * (K1 + 1.0) / (count + length_norms_[length_code]);
+    }
+
+    // With t = count / length, dropping K1 * (1 - B) from the denominator and using the
+    // exact length, never above the decoded one, gives (K1 + 1) * t / (t + K1 * B / avg)
+    double GetUpperBound(double max_term_freq) const {
+        return max_term_freq * (K1 + 1.0) / (max_term_freq + bound_norm_);
+    }
+
+private:
+    std::array<double, 256> length_norms_{}; // the length part of the denominator, by length code
+    double bound_norm_ = K1 * B;
+};
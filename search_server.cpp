@@ -1,188 +1,937 @@
 #include "search_server.h"
 
-SearchServer::SearchServer(const std::string_view stop_words_text)
-    : SearchServer(SplitIntoWords(stop_words_text))  // Invoke delegating constructor from string container
+#include <atomic>
+
+namespace {
+
+template <typename GetString>
+void WriteStrings(SnapshotWriter& writer, size_t count, GetString get_string) {
+    vector<uint64_t> offsets{ 0 };
+    string chars;
+    for (size_t i = 0; i < count; ++i) {
+        chars += get_string(i);
+        offsets.push_back(chars.size());
+    }
+    writer.Write<uint64_t>(count);
+    writer.WriteArray(offsets.data(), offsets.size());
+    writer.WriteArray(chars.data(), chars.size());
+}
+
+// The views point into the mapped file
+vector<string_view> ReadStrings(SnapshotReader& reader) {
+    const size_t count = reader.Read<uint64_t>();
+    const uint64_t* offsets = reader.ReadArray<uint64_t>(count + 1);
+    const char* chars = reader.ReadArray<char>(offsets[count]);
+    vector<string_view> strings;
+    strings.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (offsets[i] > offsets[i + 1]) {
+            throw invalid_argument("Snapshot is corrupted"s);
+        }
+        strings.emplace_back(chars + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    return strings;
+}
+
+// A static member would count separately in every BasicSearchServer instantiation
+std::atomic<uint64_t> next_generation = 0;
+
+// Inverse of the stored 1 / word count
+int64_t CountWords(double inv_word_count) {
+    return llround(1.0 / inv_word_count);
+}
+
+}  // namespace
+
+template <typename Scorer>
+BasicSearchServer<Scorer>::BasicSearchServer(const std::string_view stop_words_text)
+    : BasicSearchServer(SplitIntoWords(stop_words_text))  // Invoke delegating constructor from string container
 {
 }
 
-SearchServer::SearchServer(const string& stop_words_text)
-    : SearchServer(SplitIntoWords(stop_words_text))  // Invoke delegating constructor from string container
+template <typename Scorer>
+BasicSearchServer<Scorer>::BasicSearchServer(const string& stop_words_text)
+    : BasicSearchServer(SplitIntoWords(stop_words_text))  // Invoke delegating constructor from string container
 {
 }
 
-void SearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status,
+template <typename Scorer>
+void BasicSearchServer<Scorer>::AddDocument(int document_id, const std::string_view document, DocumentStatus status,
     const vector<int>& ratings) {
+    METRICS_TIME_PHASE(ADD_DOCUMENT);
+    BuildDocuments();
     if ((document_id < 0) || (documents_.count(document_id) > 0)) {
         throw invalid_argument("Invalid document_id"s);
     }
-    storage_all_documents_.emplace_back(std::string(document));
-    auto words = SplitIntoWordsNoStop(storage_all_documents_.back()); //создаем буфер для всех документов
-    
+    // terms are copied into the dictionary, so the words may view the caller's text
+    const auto words = SplitIntoWordsNoStop(document);
+    ReleaseRemovedDocuments();
+
     const double inv_word_count = 1.0 / words.size();
+    const int rating = ComputeAverageRating(ratings);
+    const int ordinal = AddOrdinal(document_id, inv_word_count, status, rating);
+    map<int, uint32_t> term_counts;
     for (const auto word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        id_word_to_freqs_[document_id][word] += inv_word_count;
+        const int term_id = InternTerm(word);
+        ++term_counts[term_id];
+        id_word_to_freqs_[document_id][terms_.GetTerm(term_id)] += inv_word_count;
+    }
+    for (const auto& [term_id, count] : term_counts) {
+        term_postings_[term_id].Append(ordinal, count, count * inv_word_count);
+        ++live_document_freqs_[term_id];
+        MarkInverseDocumentFreqStale(term_id);
     }
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
+    documents_.emplace(document_id, DocumentData{ rating, status, ordinal });
     document_ids_.insert(document_id);
+    generation_ = NewGeneration();
+    METRICS_ADD(DOCUMENTS_ADDED, 1);
 }
-//-----------------FindTopDocuments ---------------------------------------------------------------------
-vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(
-        raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
+template <typename Scorer>
+void BasicSearchServer<Scorer>::CheckDocument(int document_id, const std::string_view document) const {
+    if ((document_id < 0) || FindDocument(document_id)) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    SplitIntoWordsNoStop(document);
+}
+
+template <typename Scorer>
+void BasicSearchServer<Scorer>::AddDocuments(const vector<DocumentToAdd>& documents) {
+    struct TokenizedDocument {
+        vector<std::string_view> words;     // unique, sorted
+        vector<pair<int, uint32_t>> terms;  // term id and count of every word
+        size_t word_count = 0;
+        exception_ptr error;
+    };
+    vector<TokenizedDocument> tokenized(documents.size());
+    // known words are resolved now, new ones are interned once the batch is checked
+    for (size_t i = 0; i < documents.size(); ++i) {
+        auto& document = tokenized[i];
+        try {
+            document.words = SplitIntoWordsNoStop(documents[i].text);
+        }
+        catch (...) {
+            document.error = current_exception();
+            continue;
+        }
+        document.word_count = document.words.size();
+        sort(document.words.begin(), document.words.end());
+        size_t unique_count = 0;
+        for (size_t begin = 0, end = 0; begin < document.words.size(); begin = end) {
+            while (end < document.words.size() && document.words[end] == document.words[begin]) {
+                ++end;
+            }
+            document.words[unique_count++] = document.words[begin];
+            document.terms.emplace_back(terms_.Find(document.words[begin]), static_cast<uint32_t>(end - begin));
+        }
+        document.words.resize(unique_count);
+    }
+
+    // the same checks in the same order as a loop of AddDocument
+    BuildDocuments();
+    set<int> batch_ids;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const int document_id = documents[i].id;
+        if (document_id < 0 || documents_.count(document_id) > 0 || !batch_ids.insert(document_id).second) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+        if (tokenized[i].error) {
+            rethrow_exception(tokenized[i].error);
+        }
+    }
+    ReleaseRemovedDocuments();
+
+    // Intern the new words and lay out the postings of the batch grouped by term;
+    // ordinals are assigned in batch order, so every group is already sorted
+    const int first_ordinal = static_cast<int>(ordinal_to_document_id_.size());
+    vector<size_t> term_posting_counts(term_postings_.size());
+    for (auto& document : tokenized) {
+        for (size_t j = 0; j < document.terms.size(); ++j) {
+            int& term_id = document.terms[j].first;
+            if (term_id == TermDictionary::NO_TERM) {
+                term_id = InternTerm(document.words[j]);
+                term_posting_counts.resize(term_postings_.size());
+            }
+            ++term_posting_counts[term_id];
+        }
+    }
+    vector<int> touched_terms;
+    vector<size_t> term_offsets(term_posting_counts.size() + 1);
+    for (size_t term_id = 0; term_id < term_posting_counts.size(); ++term_id) {
+        if (term_posting_counts[term_id] > 0) {
+            touched_terms.push_back(static_cast<int>(term_id));
+        }
+        term_offsets[term_id + 1] = term_offsets[term_id] + term_posting_counts[term_id];
+    }
+    struct BatchPosting {
+        int ordinal;
+        uint32_t count;
+    };
+    vector<BatchPosting> batch_postings(term_offsets.back());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        for (const auto& [term_id, count] : tokenized[i].terms) {
+            batch_postings[term_offsets[term_id]++] = { first_ordinal + static_cast<int>(i), count };
+        }
+    }
+
+    for (const int term_id : touched_terms) {
+        live_document_freqs_[term_id] += static_cast<int>(term_posting_counts[term_id]);
+        const size_t end = term_offsets[term_id];
+        for (size_t j = end - term_posting_counts[term_id]; j < end; ++j) {
+            const double inv_word_count = 1.0 / tokenized[batch_postings[j].ordinal - first_ordinal].word_count;
+            term_postings_[term_id].Append(batch_postings[j].ordinal, batch_postings[j].count,
+                batch_postings[j].count * inv_word_count);
+        }
+        MarkInverseDocumentFreqStale(term_id);
+    }
+
+    vector<map<std::string_view, double>> word_freqs(documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const double inv_word_count = 1.0 / tokenized[i].word_count;
+        for (const auto& [term_id, count] : tokenized[i].terms) {
+            // summed like AddDocument does, so both paths give bit-identical frequencies
+            double freq = 0.0;
+            for (uint32_t j = 0; j < count; ++j) {
+                freq += inv_word_count;
+            }
+            word_freqs[i].emplace_hint(word_freqs[i].end(), terms_.GetTerm(term_id), freq);
+        }
+    }
+
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const auto& document = documents[i];
+        const int rating = ComputeAverageRating(document.ratings);
+        AddOrdinal(document.id, 1.0 / tokenized[i].word_count, document.status, rating);
+        id_word_to_freqs_.emplace(document.id, move(word_freqs[i]));
+        documents_.emplace(document.id, DocumentData{ rating, document.status, first_ordinal + static_cast<int>(i) });
+        document_ids_.insert(document.id);
+    }
+    generation_ = NewGeneration();
+    METRICS_ADD(DOCUMENTS_ADDED, documents.size());
+}
+
+template <typename Scorer>
+void BasicSearchServer<Scorer>::MergeFrom(const BasicSearchServer& other, const set<int>& excluded_ids) {
+    BuildDocuments();
+    other.BuildDocuments();
+    for (const auto& [document_id, _] : other.documents_) {
+        if (documents_.count(document_id) > 0 && excluded_ids.count(document_id) == 0) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+    }
+    ReleaseRemovedDocuments();
+
+    // documents keep their relative order, so the appended postings stay sorted
+    vector<int> new_ordinals(other.ordinal_to_document_id_.size(), -1);
+    for (size_t ordinal = 0; ordinal < other.ordinal_to_document_id_.size(); ++ordinal) {
+        const int document_id = other.ordinal_to_document_id_[ordinal];
+        const auto it = other.documents_.find(document_id);
+        // skips removed documents, also when the id has been added again with a new ordinal
+        if (it == other.documents_.end() || it->second.ordinal != static_cast<int>(ordinal)
+            || excluded_ids.count(document_id) > 0) {
+            continue;
+        }
+        const DocumentData& document_data = it->second;
+        const int new_ordinal = AddOrdinal(document_id, other.inv_word_counts_[ordinal], document_data.status, document_data.rating);
+        new_ordinals[ordinal] = new_ordinal;
+        documents_.emplace(document_id, DocumentData{ document_data.rating, document_data.status, new_ordinal });
+        document_ids_.insert(document_id);
+        auto& word_freqs = id_word_to_freqs_[document_id];
+        for (const auto& [word, freq] : other.GetWordFrequencies(document_id)) {
+            word_freqs.emplace_hint(word_freqs.end(), terms_.GetTerm(InternTerm(word)), freq);
+        }
+    }
+
+    for (size_t term_id = 0; term_id < other.term_postings_.size(); ++term_id) {
+        const auto& postings = other.term_postings_[term_id];
+        if (postings.size() == 0) {
+            continue;
+        }
+        const int new_term_id = InternTerm(other.terms_.GetTerm(static_cast<int>(term_id)));
+        postings.ForEach([&](int ordinal, uint32_t count) {
+            const int new_ordinal = new_ordinals[ordinal];
+            if (new_ordinal >= 0) {
+                term_postings_[new_term_id].Append(new_ordinal, count, count * inv_word_counts_[new_ordinal]);
+                ++live_document_freqs_[new_term_id];
+            }
         });
+        MarkInverseDocumentFreqStale(new_term_id);
+    }
+    generation_ = NewGeneration();
+}
+
+//-----------------FindTopDocuments ---------------------------------------------------------------------
+template <typename Scorer>
+vector<Document> BasicSearchServer<Scorer>::FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+    size_t top_k) const {
+    return FindTopDocuments(raw_query, DocumentStatusPredicate{ status }, top_k);
 }
 
 //-----------------FindTopDocuments ---------------------------------------------------------------------
-vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query) const {
+template <typename Scorer>
+vector<Document> BasicSearchServer<Scorer>::FindTopDocuments(const std::string_view raw_query) const {
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
-int SearchServer::GetDocumentCount() const {
-    return static_cast<int>(documents_.size());
+template <typename Scorer>
+int BasicSearchServer<Scorer>::GetDocumentCount() const {
+    const auto& snapshot = *snapshot_documents_;
+    return static_cast<int>(snapshot.is_built.load(std::memory_order_acquire) ? documents_.size() : snapshot.document_count);
 }
 
-set<int>::const_iterator SearchServer::begin() const
+template <typename Scorer>
+typename BasicSearchServer<Scorer>::CorpusStatistics BasicSearchServer<Scorer>::GetQueryStatistics(const std::string_view raw_query) const {
+    const auto query = ParseQuery(raw_query);
+    RefreshScoring();
+    CorpusStatistics statistics;
+    statistics.document_count = GetDocumentCount();
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        const int term_id = query.plus_term_ids[i];
+        statistics.document_freqs.emplace(query.plus_words[i],
+            term_id == TermDictionary::NO_TERM ? 0 : live_document_freqs_[term_id]);
+    }
+    return statistics;
+}
+
+template <typename Scorer>
+void BasicSearchServer<Scorer>::SetQueryEvaluation(QueryEvaluation query_evaluation) {
+    query_evaluation_ = query_evaluation;
+}
+
+template <typename Scorer>
+QueryEvaluation BasicSearchServer<Scorer>::GetQueryEvaluation() const {
+    return query_evaluation_;
+}
+
+template <typename Scorer>
+void BasicSearchServer<Scorer>::SetInverseDocumentFreqTolerance(double tolerance) {
+    if (!(tolerance >= 0.0 && tolerance < 1.0)) {
+        throw invalid_argument("IDF tolerance must be in [0, 1)"s);
+    }
+    idf_tolerance_ = tolerance;
+    scoring_cache_->is_stale = true;
+    scoring_cache_->generation = NO_GENERATION;
+}
+
+template <typename Scorer>
+double BasicSearchServer<Scorer>::GetInverseDocumentFreqTolerance() const {
+    return idf_tolerance_;
+}
+
+template <typename Scorer>
+uint64_t BasicSearchServer<Scorer>::GetGeneration() const {
+    return generation_;
+}
+
+template <typename Scorer>
+uint64_t BasicSearchServer<Scorer>::NewGeneration() {
+    return next_generation++;
+}
+
+template <typename Scorer>
+string BasicSearchServer<Scorer>::GetQueryKey(const std::string_view raw_query) const {
+    const auto query = ParseQuery(raw_query);
+    string key;
+    for (const auto word : query.plus_words) {
+        key += word;
+        key += ' ';
+    }
+    for (const auto word : query.minus_words) {
+        key += '-';
+        key += word;
+        key += ' ';
+    }
+    return key;
+}
+
+template <typename Scorer>
+void BasicSearchServer<Scorer>::SaveSnapshot(const std::string& path) const {
+    RefreshScoring(); // the document frequencies are saved without the removed words
+    BuildDocuments();
+    SnapshotWriter writer(path);
+    WriteStrings(writer, stop_words_.size(), [it = stop_words_.begin()](size_t) mutable -> const string& { return *it++; });
+    WriteStrings(writer, terms_.size(), [this](size_t term_id) { return terms_.GetTerm(static_cast<int>(term_id)); });
+    for (const auto& postings : term_postings_) {
+        postings.Save(writer);
+    }
+    writer.WriteArray(live_document_freqs_.data(), live_document_freqs_.size());
+
+    writer.Write<uint64_t>(ordinal_to_document_id_.size());
+    writer.WriteArray(ordinal_to_document_id_.data(), ordinal_to_document_id_.size());
+    writer.WriteArray(inv_word_counts_.data(), inv_word_counts_.size());
+    writer.WriteArray(removed_ordinals_.data(), removed_ordinals_.size());
+    writer.Write<uint64_t>(unpurged_removed_count_);
+
+    vector<SnapshotDocument> documents;
+    documents.reserve(documents_.size());
+    for (const auto& [document_id, document_data] : documents_) {
+        documents.push_back({ document_id, document_data.rating, static_cast<int32_t>(document_data.status), document_data.ordinal });
+    }
+    writer.Write<uint64_t>(documents.size());
+    writer.WriteArray(documents.data(), documents.size());
+
+    // the words of all documents form one array, so a loaded document finds its own by offset
+    vector<uint64_t> word_offsets{ 0 };
+    word_offsets.reserve(documents_.size() + 1);
+    for (const auto& [document_id, document_data] : documents_) {
+        word_offsets.push_back(word_offsets.back() + (document_data.snapshot_word_freqs != nullptr
+            ? document_data.snapshot_word_count : GetWordFrequencies(document_id).size()));
+    }
+    writer.WriteArray(word_offsets.data(), word_offsets.size());
+    vector<SnapshotWordFreq> word_freqs;
+    for (const auto& [document_id, document_data] : documents_) {
+        if (document_data.snapshot_word_freqs != nullptr) {
+            // term ids of a loaded index never change, the loaded words are written as they are
+            writer.WriteArray(document_data.snapshot_word_freqs, document_data.snapshot_word_count);
+            continue;
+        }
+        word_freqs.clear();
+        for (const auto& [word, freq] : GetWordFrequencies(document_id)) {
+            word_freqs.push_back({ terms_.Find(word), 0, freq });
+        }
+        writer.WriteArray(word_freqs.data(), word_freqs.size());
+    }
+    writer.Finish();
+}
+
+template <typename Scorer>
+BasicSearchServer<Scorer> BasicSearchServer<Scorer>::LoadSnapshot(const std::string& path, SnapshotVerification verification) {
+    SnapshotReader reader(path, verification);
+    BasicSearchServer server(ReadStrings(reader));
+    server.snapshot_file_ = reader.GetFile();
+
+    for (const auto term : ReadStrings(reader)) {
+        if (server.terms_.InternExternal(term) != static_cast<int>(server.term_postings_.size())) {
+            throw invalid_argument("Snapshot has a duplicate term"s);
+        }
+        server.term_postings_.push_back(PostingList::Load(reader));
+    }
+    const int32_t* live_document_freqs = reader.ReadArray<int32_t>(server.term_postings_.size());
+    server.live_document_freqs_.assign(live_document_freqs, live_document_freqs + server.term_postings_.size());
+
+    const size_t ordinal_count = reader.Read<uint64_t>();
+    const int32_t* document_ids = reader.ReadArray<int32_t>(ordinal_count);
+    const double* inv_word_counts = reader.ReadArray<double>(ordinal_count);
+    server.ordinal_to_document_id_.assign(document_ids, document_ids + ordinal_count);
+    server.inv_word_counts_.assign(inv_word_counts, inv_word_counts + ordinal_count);
+    const size_t removed_word_count = (ordinal_count + 63) / 64;
+    const uint64_t* removed_ordinals = reader.ReadArray<uint64_t>(removed_word_count);
+    server.removed_ordinals_.assign(removed_ordinals, removed_ordinals + removed_word_count);
+    // lengths are derived from inv_word_counts_, so the snapshot format does not store them
+    server.ordinal_length_codes_.resize(ordinal_count);
+    for (size_t ordinal = 0; ordinal < ordinal_count; ++ordinal) {
+        const int64_t word_count = CountWords(server.inv_word_counts_[ordinal]);
+        server.ordinal_length_codes_[ordinal] = EncodeDocumentLength(word_count);
+        if (!server.IsRemoved(static_cast<int>(ordinal))) {
+            server.live_word_count_ += word_count;
+        }
+    }
+    server.ordinal_ratings_.resize(ordinal_count);
+    server.ordinal_statuses_.resize(ordinal_count);
+    for (auto& bitmap : server.status_ordinals_) {
+        bitmap.resize(removed_word_count);
+    }
+    server.unpurged_removed_count_ = reader.Read<uint64_t>();
+
+    const size_t document_count = reader.Read<uint64_t>();
+    if (document_count > ordinal_count) {
+        throw invalid_argument("Snapshot is corrupted"s);
+    }
+    const SnapshotDocument* documents = reader.ReadArray<SnapshotDocument>(document_count);
+    const uint64_t* word_offsets = reader.ReadArray<uint64_t>(document_count + 1);
+    if (word_offsets[0] != 0) {
+        throw invalid_argument("Snapshot is corrupted"s);
+    }
+    // one pass over the arrays in place, the words are checked when BuildDocuments or
+    // GetWordFrequencies first reads them
+    for (size_t i = 0; i < document_count; ++i) {
+        const SnapshotDocument& document = documents[i];
+        if (document.ordinal < 0 || static_cast<size_t>(document.ordinal) >= ordinal_count
+            || document.status < 0 || static_cast<size_t>(document.status) >= STATUS_COUNT
+            || (i > 0 && document.id <= documents[i - 1].id) || word_offsets[i + 1] < word_offsets[i]) {
+            throw invalid_argument("Snapshot is corrupted"s);
+        }
+        server.ordinal_ratings_[document.ordinal] = document.rating;
+        server.ordinal_statuses_[document.ordinal] = static_cast<DocumentStatus>(document.status);
+        server.status_ordinals_[document.status][document.ordinal / 64] |= uint64_t{ 1 } << (document.ordinal % 64);
+    }
+    const SnapshotWordFreq* word_freqs = reader.ReadArray<SnapshotWordFreq>(word_offsets[document_count]);
+    if (!reader.IsAtEnd()) {
+        throw invalid_argument("Snapshot is corrupted"s);
+    }
+    auto& snapshot_documents = *server.snapshot_documents_;
+    snapshot_documents.documents = documents;
+    snapshot_documents.document_count = document_count;
+    snapshot_documents.word_offsets = word_offsets;
+    snapshot_documents.word_freqs = word_freqs;
+    snapshot_documents.is_built = document_count == 0;
+    return server;
+}
+
+template <typename Scorer>
+set<int>::const_iterator BasicSearchServer<Scorer>::begin() const
 {
+    BuildDocuments();
     const auto begin = document_ids_.begin();
     return begin;
 }
 
-set<int>::const_iterator SearchServer::end() const
+template <typename Scorer>
+set<int>::const_iterator BasicSearchServer<Scorer>::end() const
 {
+    BuildDocuments();
     const auto end = document_ids_.end();
     return end;
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const
+template <typename Scorer>
+const std::map<std::string_view, double>& BasicSearchServer<Scorer>::GetWordFrequencies(int document_id) const
 {
-    if (!id_word_to_freqs_.count(document_id))
-    {
-        static std::map<std::string_view, double> empty;
+    static const std::map<std::string_view, double> empty;
+    // a removed document keeps its word map until ReleaseRemovedDocuments
+    const auto document_data = FindDocument(document_id);
+    if (!document_data) {
         return empty;
     }
-    return id_word_to_freqs_.at(document_id);
+    if (const auto it = id_word_to_freqs_.find(document_id); it != id_word_to_freqs_.end()) {
+        return it->second;
+    }
+    if (document_data->snapshot_word_freqs == nullptr) {
+        return empty;
+    }
+    for (size_t i = 0; i < document_data->snapshot_word_count; ++i) {
+        const int term_id = document_data->snapshot_word_freqs[i].term_id;
+        if (term_id < 0 || static_cast<size_t>(term_id) >= terms_.size()) {
+            throw invalid_argument("Snapshot is corrupted"s);
+        }
+    }
+    // map nodes never move, so the returned map stays valid while other ones are built
+    std::lock_guard guard(snapshot_word_freqs_->mutex);
+    auto [it, is_new] = snapshot_word_freqs_->documents.try_emplace(document_id);
+    if (is_new) {
+        for (size_t i = 0; i < document_data->snapshot_word_count; ++i) {
+            const SnapshotWordFreq& word_freq = document_data->snapshot_word_freqs[i];
+            it->second.emplace_hint(it->second.end(), terms_.GetTerm(word_freq.term_id), word_freq.freq);
+        }
+    }
+    return it->second;
 }
 
-tuple<vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view raw_query,
-    int document_id) const {
-    const auto query = ParseQuery(raw_query);
+template <typename Scorer>
+int BasicSearchServer<Scorer>::FindTermId(std::string_view word) const {
+    return terms_.Find(word);
+}
+
+template <typename Scorer>
+size_t BasicSearchServer<Scorer>::GetTermCount() const {
+    return terms_.size();
+}
 
+template <typename Scorer>
+typename BasicSearchServer<Scorer>::DocumentTermIds BasicSearchServer<Scorer>::GetDocumentTermIds() const {
+    BuildDocuments();
+    DocumentTermIds result;
+    vector<int> ordinal_to_index(ordinal_to_document_id_.size(), -1);
+    for (const auto& [document_id, document] : documents_) {
+        ordinal_to_index[document.ordinal] = static_cast<int>(result.document_ids.size());
+        result.document_ids.push_back(document_id);
+    }
+
+    // count the words of every document, then place the term ids, visiting the terms
+    // in ascending order keeps the ids of every document sorted
+    result.offsets.assign(result.document_ids.size() + 1, 0);
+    for (const auto& postings : term_postings_) {
+        postings.ForEach([&](int ordinal, uint32_t) {
+            if (ordinal_to_index[ordinal] >= 0) {
+                ++result.offsets[ordinal_to_index[ordinal] + 1];
+            }
+        });
+    }
+    partial_sum(result.offsets.begin(), result.offsets.end(), result.offsets.begin());
+    result.term_ids.resize(result.offsets.back());
+    vector<size_t> positions(result.offsets.begin(), result.offsets.end() - 1);
+    for (size_t term_id = 0; term_id < term_postings_.size(); ++term_id) {
+        term_postings_[term_id].ForEach([&](int ordinal, uint32_t) {
+            if (ordinal_to_index[ordinal] >= 0) {
+                result.term_ids[positions[ordinal_to_index[ordinal]]++] = static_cast<int>(term_id);
+            }
+        });
+    }
+    return result;
+}
+
+template <typename Scorer>
+tuple<vector<std::string_view>, DocumentStatus> BasicSearchServer<Scorer>::MatchDocument(const std::string_view raw_query,
+    int document_id) const {
     vector<std::string_view> matched_words;
-    if (std::any_of(query.minus_words.begin(), query.minus_words.end(), [&](const auto& word) {return word_to_document_freqs_.at(word).count(document_id); })) {
-        return { matched_words, documents_.at(document_id).status };
+    const DocumentStatus status = MatchDocument(raw_query, document_id, matched_words);
+    return { matched_words, status };
+}
+
+template <typename Scorer>
+DocumentStatus BasicSearchServer<Scorer>::MatchDocument(const std::string_view raw_query, int document_id,
+    vector<std::string_view>& matched_words) const {
+    METRICS_TIME_PHASE(MATCH_DOCUMENT);
+    const auto context = ThreadLocalPool<QueryContext>::Acquire();
+    auto& query = context->query;
+    ParseQuery(raw_query, context->words, query);
+    ResolveQueryTerms(query);
+    const auto document = FindDocument(document_id);
+    if (!document) {
+        throw out_of_range("Invalid document_id"s);
     }
-    for (const auto word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
+    const DocumentData& document_data = *document;
+
+    matched_words.clear();
+    if (std::any_of(query.minus_term_ids.begin(), query.minus_term_ids.end(), [&](const int term_id) {return DocumentHasTerm(term_id, document_data.ordinal); })) {
+        return document_data.status;
+    }
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        if (DocumentHasTerm(query.plus_term_ids[i], document_data.ordinal)) {
+            matched_words.push_back(query.plus_words[i]);
         }
     }
+    return document_data.status;
+}
 
-    return { matched_words, documents_.at(document_id).status };
+template <typename Scorer>
+tuple<vector<std::string_view>, DocumentStatus> BasicSearchServer<Scorer>::MatchDocument(std::execution::sequenced_policy seq, const std::string_view raw_query, int document_id) const
+{
+    return MatchDocument(raw_query, document_id);
 }
 
-tuple<vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy seq, const std::string_view raw_query, int document_id) const
+template <typename Scorer>
+tuple<vector<std::string_view>, DocumentStatus> BasicSearchServer<Scorer>::MatchDocument(std::execution::parallel_policy par, const std::string_view  raw_query, int document_id) const
 {
+    // a query has too few words to be worth splitting between threads
     return MatchDocument(raw_query, document_id);
 }
 
-tuple<vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy par, const std::string_view  raw_query, int document_id) const
+template <typename Scorer>
+vector<tuple<vector<std::string_view>, DocumentStatus>> BasicSearchServer<Scorer>::MatchDocuments(const std::string_view raw_query,
+    const vector<int>& document_ids) const {
+    return MatchDocuments(raw_query, document_ids, 1);
+}
+
+template <typename Scorer>
+vector<tuple<vector<std::string_view>, DocumentStatus>> BasicSearchServer<Scorer>::MatchDocuments(std::execution::sequenced_policy seq,
+    const std::string_view raw_query, const vector<int>& document_ids) const {
+    return MatchDocuments(raw_query, document_ids, 1);
+}
+
+template <typename Scorer>
+vector<tuple<vector<std::string_view>, DocumentStatus>> BasicSearchServer<Scorer>::MatchDocuments(std::execution::parallel_policy par,
+    const std::string_view raw_query, const vector<int>& document_ids) const {
+    const size_t chunk_count = std::min(ThreadPool::GetDefault().GetThreadCount(),
+        (document_ids.size() + MIN_PARALLEL_MATCH_BATCH - 1) / MIN_PARALLEL_MATCH_BATCH);
+    return MatchDocuments(raw_query, document_ids, std::max<size_t>(chunk_count, 1));
+}
+
+template <typename Scorer>
+void BasicSearchServer<Scorer>::RemoveDocument(int document_id)
 {
-    bool flag = true;
-    const auto query = ParseQuery(flag, raw_query);
+    // queries skip the tombstoned ordinal until the next purge
+    BuildDocuments();
+    const auto it = documents_.find(document_id);
+    if (it == documents_.end()) {
+        throw out_of_range("Invalid document_id"s);
+    }
+    const DocumentData& document_data = it->second;
+    const int ordinal = document_data.ordinal;
+    removed_ordinals_[ordinal / 64] |= uint64_t{ 1 } << (ordinal % 64);
+    status_ordinals_[static_cast<size_t>(document_data.status)][ordinal / 64] &= ~(uint64_t{ 1 } << (ordinal % 64));
+    ++unpurged_removed_count_;
+    live_word_count_ -= CountWords(inv_word_counts_[ordinal]);
+    removed_documents_.push_back({ document_id, document_data.snapshot_word_freqs, document_data.snapshot_word_count });
 
-    vector<std::string_view> matched_words;
+    documents_.erase(it);
+
+    document_ids_.erase(document_id);
+    generation_ = NewGeneration();
+}
 
-    if (std::any_of(execution::par, query.minus_words.begin(), query.minus_words.end(), [&](const auto& word) {return word_to_document_freqs_.at(word).count(document_id); })) {
-        return { matched_words, documents_.at(document_id).status };
+template <typename Scorer>
+void BasicSearchServer<Scorer>::RemoveDocument(std::execution::sequenced_policy seq, int document_id) {
+    RemoveDocument(document_id);
+}
+
+template <typename Scorer>
+void BasicSearchServer<Scorer>::RemoveDocument(std::execution::parallel_policy par, int document_id) {
+    // a removal only sets a tombstone, there is nothing left worth splitting between threads
+    if (FindDocument(document_id))
+    {
+        RemoveDocument(document_id);
     }
-    matched_words.resize(query.plus_words.size());
+}
 
-    auto it = std::copy_if(par,
-        query.plus_words.begin(), query.plus_words.end(),
-        matched_words.begin(),
-        [&](const auto& word) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                return false;
+template <typename Scorer>
+void BasicSearchServer<Scorer>::PurgeRemovedDocuments() {
+    ReleaseRemovedDocuments();
+    if (unpurged_removed_count_ == 0) {
+        return;
+    }
+    // a list holding tombstoned postings is longer than its live document count
+    ThreadPool::GetDefault().ParallelFor(term_postings_.size(), [this](const size_t term_id) {
+        const auto& postings = term_postings_[term_id];
+        if (postings.size() == static_cast<size_t>(live_document_freqs_[term_id])) {
+            return;
+        }
+        PostingList purged;
+        postings.ForEach([&](int ordinal, uint32_t count) {
+            if (!IsRemoved(ordinal)) {
+                purged.Append(ordinal, count, count * inv_word_counts_[ordinal]);
             }
-            if (word_to_document_freqs_.at(word).count(document_id)) {
+        });
+        term_postings_[term_id] = move(purged);
+    });
+    unpurged_removed_count_ = 0;
+}
+
+template <typename Scorer>
+size_t BasicSearchServer<Scorer>::GetUnpurgedRemovedCount() const {
+    return unpurged_removed_count_;
+}
 
-                return true;
+template <typename Scorer>
+void BasicSearchServer<Scorer>::ApplyRemovedDocuments() const {
+    auto& cache = *scoring_cache_;
+    for (; cache.applied_removed_count < removed_documents_.size(); ++cache.applied_removed_count) {
+        const RemovedDocument& document = removed_documents_[cache.applied_removed_count];
+        for (size_t i = 0; i < document.snapshot_word_count; ++i) {
+            const int term_id = document.snapshot_word_freqs[i].term_id;
+            --live_document_freqs_[term_id];
+            MarkInverseDocumentFreqStale(term_id);
+        }
+        const auto it = id_word_to_freqs_.find(document.document_id);
+        if (it != id_word_to_freqs_.end()) {
+            for (const auto& [word, _] : it->second) {
+                const int term_id = terms_.Find(word);
+                --live_document_freqs_[term_id];
+                MarkInverseDocumentFreqStale(term_id);
             }
-            return false;
-        });
-    std::sort(execution::par, matched_words.begin(), it);
-    auto it_match = std::unique(execution::par, matched_words.begin(), it);
-    matched_words.erase(it_match, matched_words.end());
-    return { matched_words, documents_.at(document_id).status };
+        }
+    }
 }
 
-void SearchServer::RemoveDocument(int document_id)
-{
-    for (const auto& [word, _] : id_word_to_freqs_.at(document_id)) {
-        word_to_document_freqs_.at(word).erase(document_id);
+template <typename Scorer>
+void BasicSearchServer<Scorer>::ReleaseRemovedDocuments() {
+    if (removed_documents_.empty()) {
+        return;
     }
+    {
+        std::lock_guard guard(scoring_cache_->mutex);
+        ApplyRemovedDocuments();
+        scoring_cache_->applied_removed_count = 0;
+    }
+    for (const RemovedDocument& document : removed_documents_) {
+        id_word_to_freqs_.erase(document.document_id);
+        snapshot_word_freqs_->documents.erase(document.document_id);
+    }
+    removed_documents_.clear();
+}
 
-    id_word_to_freqs_.erase(document_id);
+template <typename Scorer>
+void BasicSearchServer<Scorer>::BuildDocuments() const {
+    auto& snapshot = *snapshot_documents_;
+    if (snapshot.is_built.load(std::memory_order_acquire)) {
+        return;
+    }
+    std::lock_guard guard(snapshot.mutex);
+    if (snapshot.is_built.load(std::memory_order_relaxed)) {
+        return;
+    }
+    for (size_t i = 0; i < snapshot.document_count; ++i) {
+        const auto begin = snapshot.word_freqs + snapshot.word_offsets[i];
+        const auto end = snapshot.word_freqs + snapshot.word_offsets[i + 1];
+        if (any_of(begin, end, [this](const SnapshotWordFreq& word_freq) {
+            return word_freq.term_id < 0 || static_cast<size_t>(word_freq.term_id) >= terms_.size();
+        })) {
+            throw invalid_argument("Snapshot is corrupted"s);
+        }
+    }
+    for (size_t i = 0; i < snapshot.document_count; ++i) {
+        const SnapshotDocument& document = snapshot.documents[i];
+        // ids are ascending, so every insertion goes to the end
+        documents_.emplace_hint(documents_.end(), document.id,
+            DocumentData{ document.rating, static_cast<DocumentStatus>(document.status), document.ordinal,
+                snapshot.word_freqs + snapshot.word_offsets[i], snapshot.word_offsets[i + 1] - snapshot.word_offsets[i] });
+        document_ids_.emplace_hint(document_ids_.end(), document.id);
+    }
+    snapshot.is_built.store(true, std::memory_order_release);
+}
 
-    documents_.erase(document_id);
+template <typename Scorer>
+std::optional<typename BasicSearchServer<Scorer>::DocumentData> BasicSearchServer<Scorer>::FindDocument(int document_id) const {
+    const auto& snapshot = *snapshot_documents_;
+    if (snapshot.is_built.load(std::memory_order_acquire)) {
+        const auto it = documents_.find(document_id);
+        if (it == documents_.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+    const SnapshotDocument* const end = snapshot.documents + snapshot.document_count;
+    const SnapshotDocument* const it = lower_bound(snapshot.documents, end, document_id,
+        [](const SnapshotDocument& document, int id) { return document.id < id; });
+    if (it == end || it->id != document_id) {
+        return std::nullopt;
+    }
+    const size_t i = it - snapshot.documents;
+    return DocumentData{ it->rating, static_cast<DocumentStatus>(it->status), it->ordinal,
+        snapshot.word_freqs + snapshot.word_offsets[i], snapshot.word_offsets[i + 1] - snapshot.word_offsets[i] };
+}
 
-    document_ids_.erase(document_id);
+template <typename Scorer>
+int BasicSearchServer<Scorer>::InternTerm(std::string_view word) {
+    const int term_id = terms_.Intern(word);
+    if (term_id == static_cast<int>(term_postings_.size())) {
+        term_postings_.emplace_back();
+        live_document_freqs_.push_back(0);
+    }
+    return term_id;
 }
 
-void SearchServer::RemoveDocument(std::execution::sequenced_policy seq, int document_id) {
-    RemoveDocument(document_id);
+template <typename Scorer>
+int BasicSearchServer<Scorer>::AddOrdinal(int document_id, double inv_word_count, DocumentStatus status, int rating) {
+    const int ordinal = static_cast<int>(ordinal_to_document_id_.size());
+    ordinal_to_document_id_.push_back(document_id);
+    inv_word_counts_.push_back(inv_word_count);
+    const int64_t word_count = CountWords(inv_word_count);
+    ordinal_length_codes_.push_back(EncodeDocumentLength(word_count));
+    live_word_count_ += word_count;
+    ordinal_ratings_.push_back(rating);
+    ordinal_statuses_.push_back(status);
+    if (ordinal % 64 == 0) {
+        removed_ordinals_.push_back(0);
+        for (auto& bitmap : status_ordinals_) {
+            bitmap.push_back(0);
+        }
+    }
+    status_ordinals_[static_cast<size_t>(status)][ordinal / 64] |= uint64_t{ 1 } << (ordinal % 64);
+    return ordinal;
 }
 
-void SearchServer::RemoveDocument(std::execution::parallel_policy par, int document_id) {
-    if (id_word_to_freqs_.count(document_id))
-    {
-        std::vector<const std::string_view*> vector_ptr(id_word_to_freqs_.at(document_id).size()); //создаем вектор указателей на слова
-        std::transform(par,
-            id_word_to_freqs_.at(document_id).begin(), id_word_to_freqs_.at(document_id).end(),
-            vector_ptr.begin(),
-            [&](auto& lhs) {return &lhs.first; });//ПАРАЛЛЕЛЬНО заполняем вектор указателями тех слов, которые есть в документе document_id
-        std::for_each(par,
-            vector_ptr.begin(), vector_ptr.end(),
-            [&](const auto& lhs) { word_to_document_freqs_.at(*lhs).erase(document_id); });//ПАРАЛЛЕЛЬНО удаляем из word_to_document_freqs_ эти документы, в которых есть слова из вектора vector_ptr
+template <typename Scorer>
+void BasicSearchServer<Scorer>::MarkInverseDocumentFreqStale(int term_id) const {
+    auto& cache = *scoring_cache_;
+    if (cache.is_stale) {
+        return;
+    }
+    // past this size recomputing every term is as cheap as keeping the list
+    if (cache.stale_term_ids.size() >= term_postings_.size()) {
+        cache.stale_term_ids.clear();
+        cache.is_stale = true;
+        return;
+    }
+    cache.stale_term_ids.push_back(term_id);
+}
 
-        id_word_to_freqs_.erase(document_id);
+template <typename Scorer>
+void BasicSearchServer<Scorer>::RefreshScoring() const {
+    auto& cache = *scoring_cache_;
+    if (cache.generation.load(std::memory_order_acquire) == generation_) {
+        return;
+    }
+    std::lock_guard guard(cache.mutex);
+    if (cache.generation.load(std::memory_order_relaxed) == generation_) {
+        return;
+    }
+    ApplyRemovedDocuments();
+    const int live_document_count = GetDocumentCount();
+    cache.scorer.Prepare(live_document_count == 0 ? 0.0 : live_word_count_ * 1.0 / live_document_count);
+    if (idf_tolerance_ == 0.0) {
+        cache.stale_term_ids.clear();
+        cache.is_stale = true;
+        cache.generation.store(generation_, std::memory_order_release);
+        return;
+    }
+    const int64_t document_count = RoundDocumentCount(live_document_count, idf_tolerance_);
+    const auto compute = [&](int term_id) {
+        const int document_freq = live_document_freqs_[term_id];
+        cache.values[term_id] = document_freq == 0 ? 0.0 : Scorer::ComputeInverseDocumentFreq(document_count, document_freq);
+    };
+    cache.values.resize(term_postings_.size());
+    if (cache.is_stale || cache.document_count != document_count) {
+        for (size_t term_id = 0; term_id < cache.values.size(); ++term_id) {
+            compute(static_cast<int>(term_id));
+        }
+        cache.document_count = document_count;
+    }
+    else {
+        for (const int term_id : cache.stale_term_ids) {
+            compute(term_id);
+        }
+    }
+    cache.stale_term_ids.clear();
+    cache.is_stale = false;
+    cache.generation.store(generation_, std::memory_order_release);
+}
+
+template <typename Scorer>
+int64_t BasicSearchServer<Scorer>::RoundDocumentCount(int document_count, double tolerance) {
+    int64_t step = 1;
+    while (step * 2 <= document_count * tolerance) {
+        step *= 2;
+    }
+    return (document_count + step - 1) / step * step;
+}
 
-        documents_.erase(document_id);
+template <typename Scorer>
+bool BasicSearchServer<Scorer>::IsRemoved(int ordinal) const {
+    return (removed_ordinals_[ordinal / 64] >> (ordinal % 64)) & 1;
+}
 
-        document_ids_.erase(document_id);
+template <typename Scorer>
+int BasicSearchServer<Scorer>::FindNextOrdinal(const vector<uint64_t>& bitmap, int ordinal, int ordinal_end) {
+    size_t word = ordinal / 64;
+    uint64_t bits = bitmap[word] & (~uint64_t{ 0 } << (ordinal % 64));
+    while (bits == 0) {
+        if (++word * 64 >= static_cast<size_t>(ordinal_end)) {
+            return ordinal_end;
+        }
+        bits = bitmap[word];
+    }
+#ifdef __GNUC__
+    const int bit = __builtin_ctzll(bits);
+#else
+    int bit = 0;
+    while (!(bits >> bit & 1)) {
+        ++bit;
     }
+#endif
+    return std::min(ordinal_end, static_cast<int>(word * 64) + bit);
 }
 
-bool SearchServer::IsStopWord(const string_view word) const {
+template <typename Scorer>
+bool BasicSearchServer<Scorer>::DocumentHasTerm(int term_id, int ordinal) const {
+    return term_id != TermDictionary::NO_TERM && term_postings_[term_id].Contains(ordinal);
+}
+
+template <typename Scorer>
+bool BasicSearchServer<Scorer>::IsStopWord(const string_view word) const {
     return stop_words_.count(word) > 0;
 }
 
-bool SearchServer::IsValidWord(const string_view word) {
+template <typename Scorer>
+bool BasicSearchServer<Scorer>::IsValidWord(const string_view word) {
     // A valid word must not contain special characters
     return none_of(word.begin(), word.end(), [](char c) {
         return c >= '\0' && c < ' ';
         });
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view text) const {
+template <typename Scorer>
+std::vector<std::string_view> BasicSearchServer<Scorer>::SplitIntoWordsNoStop(const std::string_view text) const {
     std::vector<std::string_view> words;
-    for (const auto word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw invalid_argument("Word "s + string(word) + " is invalid"s);
-        }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
+    if (!TokenizeWords(text, words)) {
+        const auto word = *find_if_not(words.begin(), words.end(), IsValidWord);
+        throw invalid_argument("Word "s + string(word) + " is invalid"s);
     }
+    words.erase(remove_if(words.begin(), words.end(), [this](const string_view word) { return IsStopWord(word); }), words.end());
     return words;
 }
 
-int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
+template <typename Scorer>
+int BasicSearchServer<Scorer>::ComputeAverageRating(const vector<int>& ratings) {
     if (ratings.empty()) {
         return 0;
     }
@@ -193,7 +942,8 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
     return rating_sum / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view text) const {
+template <typename Scorer>
+typename BasicSearchServer<Scorer>::QueryWord BasicSearchServer<Scorer>::ParseQueryWord(const std::string_view text) const {
     if (text.empty()) {
         throw invalid_argument("Query word is empty"s);
     }
@@ -210,9 +960,12 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view text
     return { word, is_minus, IsStopWord(word) };
 }
 
-SearchServer::Query SearchServer::ParseQuery(bool flag, const std::string_view text) const {
-    Query result;
-    for (const auto& word : SplitIntoWords(text)) {
+template <typename Scorer>
+void BasicSearchServer<Scorer>::ParseQuery(bool flag, const std::string_view text, vector<string_view>& words, Query& result) const {
+    result.plus_words.clear();
+    result.minus_words.clear();
+    SplitIntoWords(text, words);
+    for (const auto& word : words) {
         const auto query_word = ParseQueryWord(word);
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
@@ -223,12 +976,21 @@ SearchServer::Query SearchServer::ParseQuery(bool flag, const std::string_view t
             }
         }
     }
+}
+
+template <typename Scorer>
+typename BasicSearchServer<Scorer>::Query BasicSearchServer<Scorer>::ParseQuery(const std::string_view text) const {
+    Query result;
+    vector<string_view> words;
+    ParseQuery(text, words, result);
+    ResolveQueryTerms(result);
     return result;
 }
 
-SearchServer::Query SearchServer::ParseQuery(const std::string_view text) const {
-    
-    Query result = ParseQuery(true, text);
+template <typename Scorer>
+void BasicSearchServer<Scorer>::ParseQuery(const std::string_view text, vector<string_view>& words, Query& result) const {
+    METRICS_TIME_PHASE(PARSE);
+    ParseQuery(true, text, words, result);
     //заменили set на vector. Теперь нужно плюс и минус отсортировать, найти неуникальные слова и убрать их
 
     sort(result.plus_words.begin(), result.plus_words.end());
@@ -238,38 +1000,131 @@ SearchServer::Query SearchServer::ParseQuery(const std::string_view text) const
     sort(result.minus_words.begin(), result.minus_words.end());
     auto it_minus = std::unique(result.minus_words.begin(), result.minus_words.end());
     result.minus_words.erase(it_minus, result.minus_words.end());
+}
 
-    return result;
+template <typename Scorer>
+void BasicSearchServer<Scorer>::ResolveQueryTerms(Query& query) const {
+    query.plus_term_ids.clear();
+    for (const auto word : query.plus_words) {
+        query.plus_term_ids.push_back(terms_.Find(word));
+    }
+    query.minus_term_ids.clear();
+    for (const auto word : query.minus_words) {
+        query.minus_term_ids.push_back(terms_.Find(word));
+    }
 }
 
-SearchServer::Query SearchServer::ParseQuery(const execution::parallel_policy&, const std::string_view text) const {
-    
-    Query result;
-    for (const auto& word : SplitIntoWords(text)) {
-        const auto query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.push_back(query_word.data);
+template <typename Scorer>
+void BasicSearchServer<Scorer>::ComputeInverseDocumentFreqs(Query& query, const CorpusStatistics* statistics) const {
+    query.plus_inverse_document_freqs.clear();
+    RefreshScoring();
+    const bool is_cached = statistics == nullptr && idf_tolerance_ > 0.0;
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        const int term_id = query.plus_term_ids[i];
+        double inverse_document_freq = 0.0;
+        if (statistics == nullptr) {
+            if (term_id != TermDictionary::NO_TERM) {
+                inverse_document_freq = is_cached
+                    ? scoring_cache_->values[term_id] : ComputeWordInverseDocumentFreq(term_id);
             }
-            else {
-                result.plus_words.push_back(query_word.data);
+        }
+        else {
+            const auto it = statistics->document_freqs.find(query.plus_words[i]);
+            if (it != statistics->document_freqs.end() && it->second > 0) {
+                inverse_document_freq = Scorer::ComputeInverseDocumentFreq(statistics->document_count, it->second);
             }
         }
+        query.plus_inverse_document_freqs.push_back(inverse_document_freq);
     }
-    //заменили set на vector. Теперь нужно плюс и минус отсортировать, найти неуникальные слова и убрать их
-    sort(execution::par, result.plus_words.begin(), result.plus_words.end());
-    auto it_plus = std::unique(execution::par, result.plus_words.begin(), result.plus_words.end());
-    result.plus_words.erase(it_plus, result.plus_words.end()); 
+}
 
-    sort(execution::par, result.minus_words.begin(), result.minus_words.end());
-    auto it_minus = std::unique(execution::par, result.minus_words.begin(), result.minus_words.end());
-    result.minus_words.erase(it_minus, result.minus_words.end());
+// Existence required
+template <typename Scorer>
+vector<tuple<vector<std::string_view>, DocumentStatus>> BasicSearchServer<Scorer>::MatchDocuments(const std::string_view raw_query,
+    const vector<int>& document_ids, size_t chunk_count) const {
+    if (document_ids.size() == 1) {
+        // opening a cursor decodes one block more than a lookup
+        return { MatchDocument(raw_query, document_ids.front()) };
+    }
+    METRICS_TIME_PHASE(MATCH_DOCUMENT);
+    const auto context = ThreadLocalPool<QueryContext>::Acquire();
+    auto& query = context->query;
+    ParseQuery(raw_query, context->words, query);
+    ResolveQueryTerms(query);
 
-    
-    return result;
+    vector<pair<int, size_t>> ordinals(document_ids.size());
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        const auto document = FindDocument(document_ids[i]);
+        if (!document) {
+            throw out_of_range("Invalid document_id"s);
+        }
+        ordinals[i] = { document->ordinal, i };
+    }
+    sort(ordinals.begin(), ordinals.end());
+    vector<tuple<vector<std::string_view>, DocumentStatus>> matches(document_ids.size());
+    if (chunk_count == 1) {
+        MatchOrdinals(query, ordinals, 0, ordinals.size(), matches);
+        return matches;
+    }
+    const size_t chunk_size = (ordinals.size() + chunk_count - 1) / chunk_count;
+    ForEachIndex(execution::par, chunk_count, [&](const size_t chunk) {
+        const size_t begin = chunk * chunk_size;
+        MatchOrdinals(query, ordinals, begin, std::min(ordinals.size(), begin + chunk_size), matches);
+    });
+    return matches;
 }
 
-// Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
-}
\ No newline at end of file
+template <typename Scorer>
+void BasicSearchServer<Scorer>::MatchOrdinals(const Query& query, const vector<pair<int, size_t>>& ordinals, size_t begin, size_t end,
+    vector<tuple<vector<std::string_view>, DocumentStatus>>& matches) const {
+    if (begin >= end) {
+        return;
+    }
+    // leased by the thread matching the chunk
+    const auto context = ThreadLocalPool<EvaluationContext>::Acquire();
+    auto& cursors = context->minus_cursors;
+    cursors.clear();
+    for (const int term_id : query.minus_term_ids) {
+        if (term_id != TermDictionary::NO_TERM) {
+            cursors.emplace_back(term_postings_[term_id]);
+        }
+    }
+    // a document with a minus word matches nothing, so its matched words stay empty
+    vector<char> is_excluded(end - begin);
+    for (auto& cursor : cursors) {
+        for (size_t i = begin; i < end; ++i) {
+            cursor.NextGeq(ordinals[i].first);
+            if (cursor.GetOrdinal() == ordinals[i].first) {
+                is_excluded[i - begin] = true;
+            }
+        }
+    }
+    // plus words are sorted, so the matched words of every document come out sorted
+    for (size_t word = 0; word < query.plus_words.size(); ++word) {
+        const int term_id = query.plus_term_ids[word];
+        if (term_id == TermDictionary::NO_TERM) {
+            continue;
+        }
+        PostingList::Cursor cursor(term_postings_[term_id]);
+        for (size_t i = begin; i < end; ++i) {
+            cursor.NextGeq(ordinals[i].first);
+            if (cursor.GetOrdinal() == ordinals[i].first && !is_excluded[i - begin]) {
+                get<0>(matches[ordinals[i].second]).push_back(query.plus_words[word]);
+            }
+        }
+    }
+    for (size_t i = begin; i < end; ++i) {
+        get<1>(matches[ordinals[i].second]) = ordinal_statuses_[ordinals[i].first];
+    }
+}
+
+template <typename Scorer>
+double BasicSearchServer<Scorer>::ComputeWordInverseDocumentFreq(int term_id) const {
+    if (live_document_freqs_[term_id] == 0) {
+        return 0.0; // every document with the word is removed
+    }
+    return Scorer::ComputeInverseDocumentFreq(GetDocumentCount(), live_document_freqs_[term_id]);
+}
+
+template class BasicSearchServer<TfIdfScorer>;
+template class BasicSearchServer<Bm25Scorer>;
@@ -1,4 +1,6 @@
 #pragma once
+#include <array>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <map>
@@ -10,10 +12,25 @@
 #include <cmath>
 #include <deque>
 #include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <thread>
+#include <type_traits>
 
 #include "log_duration.h"
 #include "document.h"
-#include "concurrent_map.h"
+#include "metrics.h"
+#include "index_snapshot.h"
+#include "term_dictionary.h"
+#include "posting_list.h"
+#include "scorers.h"
+#include "score_accumulator.h"
+#include "top_documents.h"
+#include "thread_local_pool.h"
+#include "thread_pool.h"
 //#include "read_input_function.h"
 
 #include "string_processing.h"
@@ -21,26 +38,60 @@
 using namespace std;
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-constexpr double EPSILON = 1e-6;
 
-class SearchServer {
+// EXHAUSTIVE is the default: on the bench corpus the short posting lists leave WAND
+// little to skip, and its pivot bookkeeping costs more than scoring every posting
+enum class QueryEvaluation {
+    DYNAMIC_PRUNING, // Block-Max WAND, skips documents that cannot enter the top
+    EXHAUSTIVE,      // scores every posting
+};
+
+// Predicate of the status overloads of FindTopDocuments. A query filtered by it is
+// compiled to test per-status bitmaps of the index instead of calling a predicate,
+// so prefer it to an equivalent lambda
+struct DocumentStatusPredicate {
+    DocumentStatus status;
+
+    bool operator()(int, DocumentStatus document_status, int) const {
+        return document_status == status;
+    }
+};
+
+// Scorer is the ranking policy, see scorers.h. SearchServer ranks by TF-IDF
+template <typename Scorer>
+class BasicSearchServer {
 public:
     template <typename StringContainer>
-    explicit SearchServer(const StringContainer& stop_words);
+    explicit BasicSearchServer(const StringContainer& stop_words);
 
-    explicit SearchServer(const std::string& stop_words_text);
+    explicit BasicSearchServer(const std::string& stop_words_text);
 
-    explicit SearchServer(const std::string_view stop_words_text);
+    explicit BasicSearchServer(const std::string_view stop_words_text);
 
     void AddDocument(int document_id, const string_view document, DocumentStatus status,
         const vector<int>& ratings);
 
+    // Throws like AddDocument would for the document, without adding it
+    void CheckDocument(int document_id, const string_view document) const;
+
+    // Bulk version of AddDocument for loading many documents at once. The postings of
+    // the batch are grouped by term and every posting list is appended to in one
+    // run instead of once per document. Throws like AddDocument would for the first invalid document of the
+    // batch; then no document of the batch is added.
+    void AddDocuments(const vector<DocumentToAdd>& documents);
+
+    // Appends the documents of another index with the same stop words, except the
+    // excluded ones, without tokenizing them again. Used to merge index segments.
+    // Throws invalid_argument if a merged id is already in this index.
+    void MergeFrom(const BasicSearchServer& other, const set<int>& excluded_ids);
+
     //-----------------FindTopDocuments ---------------------------------------------------------------------
     template <typename DocumentPredicate>
     vector<Document> FindTopDocuments(const std::string_view raw_query,
-        DocumentPredicate document_predicate) const;
+        DocumentPredicate document_predicate, size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
-    vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const;
+    vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+        size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
     vector<Document> FindTopDocuments(const std::string_view raw_query) const;
 
@@ -48,16 +99,77 @@ public:
     //-----------------FindTopDocuments execution::par-------------------------------------------------------
     template <typename Policy, typename DocumentPredicate>
     vector<Document> FindTopDocuments(const Policy& policy, const std::string_view raw_query,
-        DocumentPredicate document_predicate) const;
+        DocumentPredicate document_predicate, size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <typename Policy>
-    vector<Document> FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentStatus status) const;
+    vector<Document> FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentStatus status,
+        size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <typename Policy>
     vector<Document> FindTopDocuments(const Policy& policy, const std::string_view raw_query) const;
 
+    // Writes the found documents into documents, reusing their memory. The scratch
+    // buffers of a query are kept by the thread between queries, so once a thread has
+    // run a few queries, a query under execution::seq allocates nothing
+    template <typename Policy, typename DocumentPredicate>
+    void FindTopDocuments(const Policy& policy, const std::string_view raw_query,
+        DocumentPredicate document_predicate, size_t top_k, vector<Document>& documents) const;
+
     int GetDocumentCount() const;
 
+    // Statistics IDF is computed from. An index holding a part of the corpus has to rank with
+    // the statistics of the whole corpus to produce the same relevance as one big index
+    struct CorpusStatistics {
+        int document_count = 0;
+        map<string, int, less<>> document_freqs; // number of documents containing the word
+    };
+
+    // Local statistics of the plus words of the query
+    CorpusStatistics GetQueryStatistics(const std::string_view raw_query) const;
+
+    template <typename Policy, typename DocumentPredicate>
+    vector<Document> FindTopDocuments(const Policy& policy, const std::string_view raw_query,
+        DocumentPredicate document_predicate, size_t top_k, const CorpusStatistics& statistics) const;
+
+    void SetQueryEvaluation(QueryEvaluation query_evaluation);
+
+    QueryEvaluation GetQueryEvaluation() const;
+
+    // IDF of a word is Scorer::ComputeInverseDocumentFreq(N, document frequency). Zero, the
+    // default, computes the exact IDF in every query. With a positive tolerance N is rounded
+    // up to a step of at most tolerance * N, and the IDF of every term is precomputed: the
+    // first query after a change recomputes the terms whose document frequency changed, or
+    // all of them once N moves to another step. The IDF is then off by up to
+    // log(1 + tolerance), which is no relative bound: it can be most of the IDF of a word
+    // found in nearly every document. Queries ranked with CorpusStatistics always use the
+    // exact IDF, the average document length of BM25 stays the one of this index
+    void SetInverseDocumentFreqTolerance(double tolerance);
+
+    double GetInverseDocumentFreqTolerance() const;
+
+    // Changes with every document added or removed, results found at one generation
+    // stay valid as long as it does not change. Generations are unique across indexes,
+    // so an index replaced by another one never has the generation of the old one
+    uint64_t GetGeneration() const;
+
+    // Normalized query: the sorted distinct plus and minus words without stop words.
+    // Queries with the same key find the same documents. Throws like FindTopDocuments
+    // for an invalid query
+    string GetQueryKey(const std::string_view raw_query) const;
+
+    // Writes the index to a binary snapshot file, see index_snapshot.h. The document
+    // texts are not saved, nothing reads them once a document is indexed
+    void SaveSnapshot(const std::string& path) const;
+
+    // Restores a saved index without tokenizing the documents again. Posting lists are
+    // read in place from the mapped file, a list is copied to the heap only when a
+    // document is added to it or its removed documents are purged. The documents stay
+    // in the file too: lookups by id search them there, the id map is built when the
+    // documents are first iterated or changed, and GetWordFrequencies builds the word
+    // map of a document on first use. SnapshotVerification::STRUCTURE skips the checksum
+    static BasicSearchServer LoadSnapshot(const std::string& path,
+        SnapshotVerification verification = SnapshotVerification::CHECKSUM);
+
     set<int>::const_iterator begin() const;
 
     set<int>::const_iterator end() const;
@@ -65,6 +177,23 @@ public:
 
     const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
 
+    // Distinct words of every document as term ids, which identify words within this
+    // index only. Built in one pass over the posting lists, for analyses of the whole
+    // index that would otherwise look up the words of each document one by one
+    struct DocumentTermIds {
+        vector<int> document_ids;  // ascending
+        vector<size_t> offsets;    // the i-th document has term_ids[offsets[i], offsets[i + 1])
+        vector<int> term_ids;      // ascending within a document
+    };
+
+    DocumentTermIds GetDocumentTermIds() const;
+
+    // TermDictionary::NO_TERM if the word has never been indexed
+    int FindTermId(std::string_view word) const;
+
+    // Term ids are below this count
+    size_t GetTermCount() const;
+
     tuple<vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query,
         int document_id) const;
     tuple<vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy seq, const std::string_view raw_query,
@@ -72,25 +201,182 @@ public:
     tuple<vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy par, const std::string_view raw_query,
         int document_id) const;
 
+    // Writes the matched words into matched_words, reusing their memory, and returns the
+    // status; allocates nothing once the thread has matched a few queries
+    DocumentStatus MatchDocument(const std::string_view raw_query, int document_id,
+        vector<std::string_view>& matched_words) const;
+
+    // MatchDocument for many documents at once, results are in the order of document_ids.
+    // The query is parsed once and the postings of every term are walked once over the
+    // documents sorted by ordinal. The par overload splits large batches between threads
+    vector<tuple<vector<std::string_view>, DocumentStatus>> MatchDocuments(const std::string_view raw_query,
+        const vector<int>& document_ids) const;
+    vector<tuple<vector<std::string_view>, DocumentStatus>> MatchDocuments(std::execution::sequenced_policy seq,
+        const std::string_view raw_query, const vector<int>& document_ids) const;
+    vector<tuple<vector<std::string_view>, DocumentStatus>> MatchDocuments(std::execution::parallel_policy par,
+        const std::string_view raw_query, const vector<int>& document_ids) const;
+
+    // Tombstones the document and updates the live counters, nothing else: the postings
+    // stay until PurgeRemovedDocuments and the words leave the document frequencies with
+    // the next query
     void RemoveDocument(int document_id);
 
     void RemoveDocument(std::execution::sequenced_policy seq, int document_id);
 
     void RemoveDocument(std::execution::parallel_policy par, int document_id);
 
+    // Drops the postings and word maps of the removed documents. Never runs by itself, the
+    // owner calls it between batches of removals, e.g. once GetUnpurgedRemovedCount() exceeds
+    // GetDocumentCount(). Like AddDocument and RemoveDocument it is a writer: it must not run
+    // concurrently with queries or other writers
+    void PurgeRemovedDocuments();
+
+    // Removed documents whose postings are still in the index
+    size_t GetUnpurgedRemovedCount() const;
+
 private:
+    static constexpr size_t STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+    static constexpr double DEFAULT_IDF_TOLERANCE = 0.0;
+    static constexpr uint64_t NO_GENERATION = numeric_limits<uint64_t>::max();
+    // smaller MatchDocuments batches are not worth splitting between threads
+    static constexpr size_t MIN_PARALLEL_MATCH_BATCH = 1024;
+
+    // Guarded by mutex, except that queries read scorer and values once generation equals
+    // generation_ of the index. Writers, which never run alongside queries, mark terms stale
+    struct ScoringCache {
+        std::mutex mutex;
+        std::atomic<uint64_t> generation{ NO_GENERATION };
+        Scorer scorer;               // prepared with the average length of the live documents
+        int64_t document_count = 0;  // rounded N of the values
+        vector<double> values;       // indexed by term id
+        vector<int> stale_term_ids;  // document frequency changed since the values were computed
+        bool is_stale = true;        // every value has to be recomputed
+        size_t applied_removed_count = 0; // leading removed_documents_ out of live_document_freqs_
+    };
+
+    struct SnapshotWordFreq {
+        int32_t term_id;
+        int32_t unused;
+        double freq;
+    };
+
+    struct SnapshotDocument {
+        int32_t id;
+        int32_t rating;
+        int32_t status;
+        int32_t ordinal;
+    };
+
     struct DocumentData {
         int rating;
         DocumentStatus status;
+        int ordinal;
+        // words of a document loaded from a snapshot, in the mapped file; such a document
+        // has no entry in id_word_to_freqs_ until GetWordFrequencies asks for it
+        const SnapshotWordFreq* snapshot_word_freqs = nullptr;
+        size_t snapshot_word_count = 0;
+    };
+
+    // A removed document whose words still have to leave live_document_freqs_ or whose word
+    // map still has to be dropped
+    struct RemovedDocument {
+        int document_id;
+        const SnapshotWordFreq* snapshot_word_freqs;
+        size_t snapshot_word_count;
+    };
+
+    // Maps of GetWordFrequencies built on demand for documents loaded from a snapshot.
+    // Guarded by mutex, const queries may build them concurrently
+    struct SnapshotWordFreqsCache {
+        std::mutex mutex;
+        map<int, map<std::string_view, double>> documents;
+    };
+
+    // Documents of a loaded snapshot, in the mapped file, until BuildDocuments moves them
+    // into documents_ and document_ids_. Guarded by mutex, const calls may build them
+    // concurrently; is_built is set once they are and stays set
+    struct SnapshotDocuments {
+        std::mutex mutex;
+        std::atomic<bool> is_built{ true };
+        const SnapshotDocument* documents = nullptr; // ascending ids
+        size_t document_count = 0;
+        const uint64_t* word_offsets = nullptr;      // the i-th document has word_freqs[word_offsets[i], word_offsets[i + 1])
+        const SnapshotWordFreq* word_freqs = nullptr;
     };
 
-    std::deque<std::string> storage_all_documents_;
+    std::shared_ptr<const MappedFile> snapshot_file_; // backs the posting lists of a loaded snapshot
 
     const set<string, less<>> stop_words_;
-    map<std::string_view, map<int, double>> word_to_document_freqs_;
-    map<int, map<std::string_view, double>> id_word_to_freqs_;
-    map<int, DocumentData> documents_;
-    set<int> document_ids_;
+    TermDictionary terms_;
+    vector<PostingList> term_postings_; // indexed by term id
+    // indexed by internal document ordinal, ordinals grow with every AddDocument and are never reused
+    vector<int> ordinal_to_document_id_;
+    vector<double> inv_word_counts_;
+    vector<uint8_t> ordinal_length_codes_; // EncodeDocumentLength of the word count
+    vector<int> ordinal_ratings_;
+    vector<DocumentStatus> ordinal_statuses_;
+    vector<uint64_t> removed_ordinals_; // tombstone bitmap
+    array<vector<uint64_t>, STATUS_COUNT> status_ordinals_; // bitmaps of the documents not removed, by status
+    size_t unpurged_removed_count_ = 0;
+    // indexed by term id, documents not removed; RefreshScoring takes the removed words out
+    // under the scoring cache mutex
+    mutable vector<int> live_document_freqs_;
+    int64_t live_word_count_ = 0;      // words of the documents not removed
+    map<int, map<std::string_view, double>> id_word_to_freqs_; // documents added to this index
+    vector<RemovedDocument> removed_documents_; // since the last ReleaseRemovedDocuments
+    std::unique_ptr<SnapshotWordFreqsCache> snapshot_word_freqs_ = std::make_unique<SnapshotWordFreqsCache>();
+    std::unique_ptr<SnapshotDocuments> snapshot_documents_ = std::make_unique<SnapshotDocuments>();
+    // read and changed only after BuildDocuments
+    mutable map<int, DocumentData> documents_;
+    mutable set<int> document_ids_;
+    QueryEvaluation query_evaluation_ = QueryEvaluation::EXHAUSTIVE;
+    double idf_tolerance_ = DEFAULT_IDF_TOLERANCE;
+    std::unique_ptr<ScoringCache> scoring_cache_ = std::make_unique<ScoringCache>();
+    uint64_t generation_ = NewGeneration();
+
+    static uint64_t NewGeneration();
+
+    // Interns the word and creates its posting list if the word is new
+    int InternTerm(std::string_view word);
+
+    // To be called whenever the document frequency of the term changes
+    void MarkInverseDocumentFreqStale(int term_id) const;
+
+    // Takes the words of removed_documents_ not yet applied out of live_document_freqs_.
+    // The caller holds the scoring cache mutex
+    void ApplyRemovedDocuments() const;
+
+    // Applies the removed documents and drops their word maps, writers call it before an
+    // id may be added again
+    void ReleaseRemovedDocuments();
+
+    // Prepares the scorer and, with a positive tolerance, the IDF values for the current generation
+    void RefreshScoring() const;
+
+    // Moves the snapshot documents into documents_ and document_ids_ unless that is done.
+    // Everything that walks or changes them calls it first
+    void BuildDocuments() const;
+
+    // The document of documents_, or of the snapshot documents while they are not built
+    std::optional<DocumentData> FindDocument(int document_id) const;
+
+    // Rounds document_count up to a multiple of a power of two at most tolerance * document_count
+    static int64_t RoundDocumentCount(int document_count, double tolerance);
+
+    // Returns the ordinal of the new document
+    int AddOrdinal(int document_id, double inv_word_count, DocumentStatus status, int rating);
+
+    bool IsRemoved(int ordinal) const;
+
+    // Whether the query keeps the document, read from the ordinal columns. Filtering by
+    // DocumentStatusPredicate is a bitmap test, other predicates are called
+    template <typename DocumentPredicate>
+    bool IsAccepted(DocumentPredicate& document_predicate, int ordinal) const;
+
+    // First ordinal in [ordinal, ordinal_end) set in the bitmap, ordinal_end if none
+    static int FindNextOrdinal(const vector<uint64_t>& bitmap, int ordinal, int ordinal_end);
+
+    bool DocumentHasTerm(int term_id, int ordinal) const;
 
     bool IsStopWord(const string_view word) const;
 
@@ -110,32 +396,100 @@ private:
     struct Query {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
+        // parallel to plus_words/minus_words, TermDictionary::NO_TERM for unknown words
+        std::vector<int> plus_term_ids;
+        std::vector<int> minus_term_ids;
+        // parallel to plus_words, filled right before evaluation
+        std::vector<double> plus_inverse_document_freqs;
     };
 
 
     Query ParseQuery(const std::string_view text) const;
 
-    Query ParseQuery(bool flag, const std::string_view text) const;
+    // Both parse into query reusing its memory, words is scratch for the tokenizer.
+    // Terms are left to ResolveQueryTerms
+    void ParseQuery(const std::string_view text, vector<std::string_view>& words, Query& query) const;
 
-    Query ParseQuery(const execution::parallel_policy&, const std::string_view text) const;
+    void ParseQuery(bool flag, const std::string_view text, vector<std::string_view>& words, Query& query) const;
 
-    //-----------------FindAllDocuments ---------------------------------------------------------------------
-    template <typename DocumentPredicate>
-    vector<Document> FindAllDocuments(const Query& query,
-        DocumentPredicate document_predicate) const;
+    void ResolveQueryTerms(Query& query) const;
+
+    // Corpus-wide statistics if given, the statistics of this index otherwise
+    void ComputeInverseDocumentFreqs(Query& query, const CorpusStatistics* statistics) const;
+
+    // Matches the documents [begin, end) of ordinals, which holds ordinals in ascending
+    // order with their index in matches
+    void MatchOrdinals(const Query& query, const vector<pair<int, size_t>>& ordinals, size_t begin, size_t end,
+        vector<tuple<vector<std::string_view>, DocumentStatus>>& matches) const;
+
+    vector<tuple<vector<std::string_view>, DocumentStatus>> MatchDocuments(const std::string_view raw_query,
+        const vector<int>& document_ids, size_t chunk_count) const;
+
+    struct TermCursor {
+        PostingList::Cursor cursor;
+        double inverse_document_freq;
+        double max_score;
+    };
+
+    // Scratch buffers of one query, handed out by ThreadLocalPool
+    struct QueryContext {
+        vector<std::string_view> words;
+        Query query;
+        vector<TopDocuments> chunk_tops;
+    };
+
+    // Scratch buffers of evaluating a query over one range of ordinals
+    struct EvaluationContext {
+        ScoreAccumulator accumulator;
+        vector<TermCursor> terms;
+        vector<PostingList::Cursor> minus_cursors;
+        vector<TermCursor*> order;
+    };
+
+    template <typename Policy, typename DocumentPredicate>
+    void FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t top_k, const CorpusStatistics* statistics, vector<Document>& documents) const;
 
     //-----------------FindAllDocuments execution::par-------------------------------------------------------
+    // Finds every matching document and keeps the top_k best of them, best first
     template <typename Policy, typename DocumentPredicate>
-    vector<Document> FindAllDocuments(const Policy& policy, const Query& query,
-        DocumentPredicate document_predicate) const;
+    void FindAllDocuments(const Policy& policy, const Query& query, DocumentPredicate document_predicate,
+        size_t top_k, vector<TopDocuments>& chunk_tops, vector<Document>& documents) const;
+
+    // Both evaluate the query over ordinals in [ordinal_begin, ordinal_end), under execution::par
+    // every thread takes its own range of ordinals, so threads share no mutable state
+    template <typename DocumentPredicate>
+    void EvaluateExhaustive(const Query& query, DocumentPredicate document_predicate,
+        int ordinal_begin, int ordinal_end, EvaluationContext& context, TopDocuments& top) const;
+
+    // Block-Max WAND
+    template <typename DocumentPredicate>
+    void EvaluateBlockMaxWand(const Query& query, DocumentPredicate document_predicate,
+        int ordinal_begin, int ordinal_end, EvaluationContext& context, TopDocuments& top) const;
+
+    template <typename Policy>
+    static size_t GetChunkCount();
+
+    // Calls function(i) for every i in [0, count): right here for execution::seq,
+    // on the default ThreadPool for the parallel policies
+    template <typename Policy, typename Function>
+    static void ForEachIndex(const Policy& policy, size_t count, Function function);
     // Existence required
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const;
+    double ComputeWordInverseDocumentFreq(int term_id) const;
+
 
 
 };
 
+using SearchServer = BasicSearchServer<TfIdfScorer>;
+
+// instantiated in search_server.cpp
+extern template class BasicSearchServer<TfIdfScorer>;
+extern template class BasicSearchServer<Bm25Scorer>;
+
+template <typename Scorer>
 template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer& stop_words)
+BasicSearchServer<Scorer>::BasicSearchServer(const StringContainer& stop_words)
     : stop_words_(MakeUniqueNonEmptyStrings(stop_words))  // Extract non-empty stop words
 {
     if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
@@ -143,99 +497,322 @@ SearchServer::SearchServer(const StringContainer& stop_words)
     }
 }
 //-----------------FindTopDocuments ---------------------------------------------------------------------
+template <typename Scorer>
 template <typename DocumentPredicate>
-vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query,
-    DocumentPredicate document_predicate) const {
+vector<Document> BasicSearchServer<Scorer>::FindTopDocuments(const std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t top_k) const {
     
-    return FindTopDocuments(execution::seq, raw_query, document_predicate);
+    return FindTopDocuments(execution::seq, raw_query, document_predicate, top_k);
 }
 
 //-----------------FindTopDocuments typename Policy-------------------------------------------------------
+template <typename Scorer>
 template <typename Policy, typename DocumentPredicate>
-vector<Document> SearchServer::FindTopDocuments(const Policy& policy, const std::string_view raw_query,
-    DocumentPredicate document_predicate) const {
-
-    const auto query = ParseQuery(raw_query); //Можно распараллелить этот метод 
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+vector<Document> BasicSearchServer<Scorer>::FindTopDocuments(const Policy& policy, const std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t top_k) const {
 
+    vector<Document> documents;
+    FindTopDocuments(policy, raw_query, document_predicate, top_k, nullptr, documents);
+    return documents;
+}
 
-    sort(policy, matched_documents.begin(), matched_documents.end(),//Можно распараллелить
-        [](const Document& lhs, const Document& rhs) {
-            if (abs(lhs.relevance - rhs.relevance) < EPSILON) {
-                return lhs.rating > rhs.rating;
-            }
-            else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
+template <typename Scorer>
+template <typename Policy, typename DocumentPredicate>
+vector<Document> BasicSearchServer<Scorer>::FindTopDocuments(const Policy& policy, const std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t top_k, const CorpusStatistics& statistics) const {
 
-    return matched_documents;
+    vector<Document> documents;
+    FindTopDocuments(policy, raw_query, document_predicate, top_k, &statistics, documents);
+    return documents;
 }
 //-----------------FindTopDocuments typename Policy-------------------------------------------------------
+template <typename Scorer>
 template <typename Policy>
-vector<Document> SearchServer::FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(policy,
-        raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
-        });
+vector<Document> BasicSearchServer<Scorer>::FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentStatus status,
+    size_t top_k) const {
+    return FindTopDocuments(policy, raw_query, DocumentStatusPredicate{ status }, top_k);
 }
 //-----------------FindTopDocuments typename Policy-------------------------------------------------------
+template <typename Scorer>
 template <typename Policy>
-vector<Document> SearchServer::FindTopDocuments(const Policy& policy, const std::string_view raw_query) const {
+vector<Document> BasicSearchServer<Scorer>::FindTopDocuments(const Policy& policy, const std::string_view raw_query) const {
     return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
-//-----------------FindAllDocuments ---------------------------------------------------------------------
-template <typename DocumentPredicate>
-vector<Document> SearchServer::FindAllDocuments(const Query& query,
-    DocumentPredicate document_predicate) const {
-    return FindAllDocuments(execution::seq, query, document_predicate);
+template <typename Scorer>
+template <typename Policy, typename DocumentPredicate>
+void BasicSearchServer<Scorer>::FindTopDocuments(const Policy& policy, const std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t top_k, vector<Document>& documents) const {
+    FindTopDocuments(policy, raw_query, document_predicate, top_k, nullptr, documents);
+}
+
+template <typename Scorer>
+template <typename Policy, typename DocumentPredicate>
+void BasicSearchServer<Scorer>::FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t top_k, const CorpusStatistics* statistics, vector<Document>& documents) const {
+    const auto context = ThreadLocalPool<QueryContext>::Acquire();
+    ParseQuery(raw_query, context->words, context->query);
+    {
+        METRICS_TIME_PHASE(TERM_LOOKUP);
+        ResolveQueryTerms(context->query);
+        ComputeInverseDocumentFreqs(context->query, statistics);
+    }
+    FindAllDocuments(policy, context->query, document_predicate, top_k, context->chunk_tops, documents);
 }
+
 //-----------------FindAllDocuments typename Policy-------------------------------------------------------
+template <typename Scorer>
 template <typename Policy, typename DocumentPredicate> // шаблонная политика, чтобы можно было выбрать между par/seq
-vector<Document> SearchServer::FindAllDocuments(const Policy& policy, const Query& query,
-    DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(500);//используем concurrent map
-
-    std::for_each(policy, query.plus_words.begin(), query.plus_words.end(),
-        [&](const auto& word) {
-            if (!(find_if(policy,
-            word_to_document_freqs_.begin(), word_to_document_freqs_.end(),
-            [&word](const auto& elem) {
-                    return elem.first == word;
-                }) == word_to_document_freqs_.end())) { //вместо count параллельный find_if
-
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                std::for_each(policy,
-                    word_to_document_freqs_.at(word).begin(), word_to_document_freqs_.at(word).end(),
-                    [&](const auto& elem) {
-                        const auto& document_data = documents_.at(elem.first);
-                        if (document_predicate(elem.first, document_data.status, document_data.rating)) {
-                            document_to_relevance[elem.first].ref_to_value += elem.second * inverse_document_freq;//используем concurrent map
-                        }
-                    });
+void BasicSearchServer<Scorer>::FindAllDocuments(const Policy& policy, const Query& query, DocumentPredicate document_predicate,
+    size_t top_k, vector<TopDocuments>& chunk_tops, vector<Document>& documents) const {
+    if (top_k == 0) {
+        documents.clear();
+        return;
+    }
+    const int ordinal_count = static_cast<int>(ordinal_to_document_id_.size());
+    const size_t chunk_count = GetChunkCount<Policy>();
+    const int chunk_size = static_cast<int>((ordinal_count + chunk_count - 1) / chunk_count);
+    while (chunk_tops.size() < chunk_count) {
+        chunk_tops.emplace_back(top_k, static_cast<size_t>(chunk_size));
+    }
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        chunk_tops[chunk].Reset(top_k, static_cast<size_t>(chunk_size));
+    }
+    {
+        METRICS_TIME_PHASE(SCORING);
+        ForEachIndex(policy, chunk_count,
+            [&](const size_t chunk) {
+                const int begin = static_cast<int>(chunk) * chunk_size;
+                const int end = std::min(ordinal_count, begin + chunk_size);
+                // leased by the thread evaluating the chunk
+                const auto context = ThreadLocalPool<EvaluationContext>::Acquire();
+                if (query_evaluation_ == QueryEvaluation::DYNAMIC_PRUNING) {
+                    EvaluateBlockMaxWand(query, document_predicate, begin, end, *context, chunk_tops[chunk]);
+                }
+                else {
+                    EvaluateExhaustive(query, document_predicate, begin, end, *context, chunk_tops[chunk]);
+                }
+            });
+    }
+    METRICS_TIME_PHASE(TOP_K);
+    for (size_t chunk = 1; chunk < chunk_count; ++chunk) {
+        chunk_tops.front().Merge(chunk_tops[chunk]);
+    }
+    chunk_tops.front().Release(documents);
+}
+
+template <typename Scorer>
+template <typename DocumentPredicate>
+void BasicSearchServer<Scorer>::EvaluateExhaustive(const Query& query, DocumentPredicate document_predicate,
+    int ordinal_begin, int ordinal_end, EvaluationContext& context, TopDocuments& top) const {
+    ScoreAccumulator& accumulator = context.accumulator;
+    accumulator.Reset(ordinal_begin, ordinal_end);
+    const Scorer& scorer = scoring_cache_->scorer;
+    uint64_t postings_scored = 0;
+    for (size_t i = 0; i < query.plus_term_ids.size(); ++i) {
+        const int term_id = query.plus_term_ids[i];
+        if (term_id == TermDictionary::NO_TERM) {
+            continue;
+        }
+        const double inverse_document_freq = query.plus_inverse_document_freqs[i];
+        PostingList::Cursor cursor(term_postings_[term_id]);
+        for (cursor.NextGeq(ordinal_begin); cursor.GetOrdinal() < ordinal_end; cursor.Next()) {
+            const int ordinal = cursor.GetOrdinal();
+            accumulator.Add(ordinal, scorer.Score(cursor.GetCount(), inv_word_counts_[ordinal], ordinal_length_codes_[ordinal])
+                * inverse_document_freq);
+            ++postings_scored;
+        }
+    }
+    METRICS_ADD(POSTINGS_SCORED, postings_scored);
+    {
+        METRICS_TIME_PHASE(MINUS_FILTERING);
+        for (const int term_id : query.minus_term_ids) {
+            if (term_id == TermDictionary::NO_TERM) {
+                continue;
+            }
+            PostingList::Cursor cursor(term_postings_[term_id]);
+            for (cursor.NextGeq(ordinal_begin); cursor.GetOrdinal() < ordinal_end; cursor.Next()) {
+                accumulator.Exclude(cursor.GetOrdinal());
+            }
+        }
+    }
+    uint64_t documents_matched = 0;
+    accumulator.ForEach([&](const int ordinal, const double relevance) {
+        if (IsAccepted(document_predicate, ordinal)) {
+            top.Push({ ordinal_to_document_id_[ordinal], relevance, ordinal_ratings_[ordinal] });
+            ++documents_matched;
+        }
+    });
+    METRICS_ADD(DOCUMENTS_MATCHED, documents_matched);
+}
+
+template <typename Scorer>
+template <typename DocumentPredicate>
+void BasicSearchServer<Scorer>::EvaluateBlockMaxWand(const Query& query, DocumentPredicate document_predicate,
+    int ordinal_begin, int ordinal_end, EvaluationContext& context, TopDocuments& top) const {
+    const Scorer& scorer = scoring_cache_->scorer;
+    auto& terms = context.terms; // in query order, so scores are summed in the same order for every document
+    terms.clear();
+    for (size_t i = 0; i < query.plus_term_ids.size(); ++i) {
+        const int term_id = query.plus_term_ids[i];
+        if (term_id == TermDictionary::NO_TERM || live_document_freqs_[term_id] == 0) {
+            continue;
+        }
+        const auto& postings = term_postings_[term_id];
+        const double inverse_document_freq = query.plus_inverse_document_freqs[i];
+        terms.push_back({ PostingList::Cursor(postings), inverse_document_freq,
+            scorer.GetUpperBound(postings.GetMaxTermFreq()) * inverse_document_freq });
+        terms.back().cursor.NextGeq(ordinal_begin);
+    }
+    auto& minus_cursors = context.minus_cursors;
+    minus_cursors.clear();
+    for (const int term_id : query.minus_term_ids) {
+        if (term_id != TermDictionary::NO_TERM) {
+            minus_cursors.emplace_back(term_postings_[term_id]);
+            minus_cursors.back().NextGeq(ordinal_begin);
+        }
+    }
+
+    auto& order = context.order;
+    order.clear();
+    for (auto& term : terms) {
+        order.push_back(&term);
+    }
+    const auto ordinal_of = [&order, ordinal_end](size_t i) {
+        return std::min(order[i]->cursor.GetOrdinal(), ordinal_end);
+    };
+    // Cursors only advance, so after the cursors of order[0, count) moved it is enough
+    // to sink each of them into the sorted rest, last one first
+    const auto sink_prefix = [&order](size_t count) {
+        for (size_t i = count; i-- > 0;) {
+            for (size_t j = i; j + 1 < order.size()
+                && order[j]->cursor.GetOrdinal() > order[j + 1]->cursor.GetOrdinal(); ++j) {
+                std::swap(order[j], order[j + 1]);
+            }
+        }
+    };
+    sink_prefix(order.size());
+    uint64_t postings_scored = 0;
+    uint64_t documents_matched = 0;
+
+    while (true) {
+        // A document scoring below threshold loses to the worst document of a full top
+        // even with the EPSILON tie-break, 2 * EPSILON leaves room for rounding
+        const double threshold = top.IsFull()
+            ? top.GetWorst().relevance - 2 * EPSILON : -numeric_limits<double>::infinity();
+
+        // pivot: the first document whose terms could reach the threshold
+        size_t pivot = order.size();
+        double upper_bound = 0.0;
+        for (size_t i = 0; i < order.size() && ordinal_of(i) < ordinal_end; ++i) {
+            upper_bound += order[i]->max_score;
+            if (upper_bound >= threshold) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot == order.size()) {
+            break;
+        }
+        const int pivot_ordinal = ordinal_of(pivot);
+        while (pivot + 1 < order.size() && ordinal_of(pivot + 1) == pivot_ordinal) {
+            ++pivot;
+        }
+
+        if constexpr (is_same_v<DocumentPredicate, DocumentStatusPredicate>) {
+            // documents up to the next one with the status are either below the threshold or filtered out
+            const auto& bitmap = status_ordinals_[static_cast<size_t>(document_predicate.status)];
+            if (!(bitmap[pivot_ordinal / 64] >> (pivot_ordinal % 64) & 1)) {
+                const int next_ordinal = FindNextOrdinal(bitmap, pivot_ordinal, ordinal_end);
+                for (size_t i = 0; i <= pivot; ++i) {
+                    order[i]->cursor.NextGeq(next_ordinal);
+                }
+                sink_prefix(pivot + 1);
+                continue;
+            }
+        }
+
+        // Tighter bound from the blocks around the pivot document
+        double block_bound = 0.0;
+        int next_ordinal = pivot + 1 < order.size() ? ordinal_of(pivot + 1) : ordinal_end;
+        for (size_t i = 0; i <= pivot; ++i) {
+            auto& cursor = order[i]->cursor;
+            cursor.ShallowSeek(pivot_ordinal);
+            block_bound += scorer.GetUpperBound(cursor.GetBlockMaxTermFreq()) * order[i]->inverse_document_freq;
+            next_ordinal = std::min(next_ordinal, cursor.GetBlockLastOrdinal() + 1);
+        }
+        if (block_bound < threshold) {
+            // no document before next_ordinal can enter the top
+            for (size_t i = 0; i <= pivot; ++i) {
+                order[i]->cursor.NextGeq(next_ordinal);
+            }
+            sink_prefix(pivot + 1);
+            continue;
+        }
+
+        if (ordinal_of(0) != pivot_ordinal) {
+            for (size_t i = 0; i < pivot; ++i) {
+                order[i]->cursor.NextGeq(pivot_ordinal);
             }
-        });
-
-    std::for_each(policy, query.minus_words.begin(), query.minus_words.end(),
-        [&](const auto& word) {
-            if (!(find_if(policy,
-            word_to_document_freqs_.begin(), word_to_document_freqs_.end(),
-            [&word](const auto& elem) {
-                    return elem.first == word;
-                }) == word_to_document_freqs_.end())) {//вместо count параллельный find_if
-                std::for_each(policy,
-                    word_to_document_freqs_.at(word).begin(), word_to_document_freqs_.at(word).end(),
-                    [&document_to_relevance](const auto& document_id_) {document_to_relevance.erase(document_id_.first); });
+            sink_prefix(pivot);
+            continue;
+        }
+
+        // the cursors on the pivot document are order[0, pivot], all of them advance
+        double relevance = 0.0;
+        for (auto& term : terms) {
+            if (term.cursor.GetOrdinal() == pivot_ordinal) {
+                relevance += scorer.Score(term.cursor.GetCount(), inv_word_counts_[pivot_ordinal],
+                    ordinal_length_codes_[pivot_ordinal]) * term.inverse_document_freq;
+                term.cursor.Next();
+                ++postings_scored;
             }
-        });
-    vector<Document> matched_documents;
+        }
+        sink_prefix(pivot + 1);
+        const bool is_excluded = any_of(minus_cursors.begin(), minus_cursors.end(),
+            [pivot_ordinal](PostingList::Cursor& cursor) {
+                cursor.NextGeq(pivot_ordinal);
+                return cursor.GetOrdinal() == pivot_ordinal;
+            });
+        if (!is_excluded && IsAccepted(document_predicate, pivot_ordinal)) {
+            top.Push({ ordinal_to_document_id_[pivot_ordinal], relevance, ordinal_ratings_[pivot_ordinal] });
+            ++documents_matched;
+        }
+    }
+    METRICS_ADD(POSTINGS_SCORED, postings_scored);
+    METRICS_ADD(DOCUMENTS_MATCHED, documents_matched);
+}
+
+template <typename Scorer>
+template <typename DocumentPredicate>
+bool BasicSearchServer<Scorer>::IsAccepted(DocumentPredicate& document_predicate, int ordinal) const {
+    if constexpr (is_same_v<DocumentPredicate, DocumentStatusPredicate>) {
+        const auto& bitmap = status_ordinals_[static_cast<size_t>(document_predicate.status)];
+        return bitmap[ordinal / 64] >> (ordinal % 64) & 1;
+    }
+    else {
+        return !IsRemoved(ordinal)
+            && document_predicate(ordinal_to_document_id_[ordinal], ordinal_statuses_[ordinal], ordinal_ratings_[ordinal]);
+    }
+}
 
-    for (const auto& [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {//используем concurrent map
-        matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+template <typename Scorer>
+template <typename Policy>
+size_t BasicSearchServer<Scorer>::GetChunkCount() {
+    if (std::is_same_v<std::decay_t<Policy>, execution::sequenced_policy>) {
+        return 1;
     }
-    return matched_documents;
-}
\ No newline at end of file
+    return ThreadPool::GetDefault().GetThreadCount();
+}
+
+template <typename Scorer>
+template <typename Policy, typename Function>
+void BasicSearchServer<Scorer>::ForEachIndex(const Policy&, size_t count, Function function) {
+    if (std::is_same_v<std::decay_t<Policy>, execution::sequenced_policy>) {
+        for (size_t i = 0; i < count; ++i) {
+            function(i);
+        }
+    }
+    else {
+        ThreadPool::GetDefault().ParallelFor(count, function);
+    }
+}
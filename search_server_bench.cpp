@@ -0,0 +1,1408 @@
+#include "search_server.h"
+#include "concurrent_map.h"
+#include "load_generator.h"
+#include "metrics.h"
+#include "posting_kernels.h"
+#include "process_queries.h"
+#include "query_result_cache.h"
+#include "remove_duplicates.h"
+#include "request_queue.h"
+#include "score_accumulator.h"
+#include "segmented_search_server.h"
+#include "sharded_search_server.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+string MakeWord(int index) {
+    string word = "w"s;
+    word += to_string(index);
+    return word;
+}
+
+// Per-query latency of FindTopDocuments as the vocabulary grows
+void BenchQueryLatencyByVocabulary() {
+    cout << "vocabulary\tdocuments\tus_per_query"s << endl;
+    mt19937 generator(42);
+    for (const int vocabulary_size : { 1'000, 10'000, 100'000, 500'000 }) {
+        const int words_per_document = 10;
+        const int document_count = vocabulary_size / words_per_document * 2;
+        uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+
+        SearchServer search_server("and with"s);
+        for (int id = 0; id < document_count; ++id) {
+            string text;
+            for (int i = 0; i < words_per_document; ++i) {
+                // every word appears at least once, the rest is random
+                text += MakeWord(i == 0 ? id % vocabulary_size : word_index(generator));
+                text += ' ';
+            }
+            search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+
+        const int query_count = 1'000;
+        vector<string> queries;
+        for (int i = 0; i < query_count; ++i) {
+            queries.push_back(MakeWord(word_index(generator)) + " "s + MakeWord(word_index(generator))
+                + " -"s + MakeWord(word_index(generator)));
+        }
+
+        size_t found = 0;
+        const auto start = chrono::steady_clock::now();
+        for (const string& query : queries) {
+            found += search_server.FindTopDocuments(query).size();
+        }
+        const auto elapsed = chrono::duration<double, micro>(chrono::steady_clock::now() - start);
+        cout << vocabulary_size << '\t' << document_count << '\t' << elapsed.count() / query_count
+             << "\t(found "s << found << ')' << endl;
+    }
+}
+
+ScoredOrdinals MakeScoredOrdinals(mt19937& generator, int universe, int size) {
+    vector<int> ordinals(size);
+    uniform_int_distribution<int> ordinal(0, universe - 1);
+    for (int& value : ordinals) {
+        value = ordinal(generator);
+    }
+    sort(ordinals.begin(), ordinals.end());
+    ordinals.erase(unique(ordinals.begin(), ordinals.end()), ordinals.end());
+    vector<double> scores(ordinals.size(), 0.25);
+    return { move(ordinals), move(scores) };
+}
+
+template <typename Function>
+double MeasureMs(Function function, int repeats) {
+    const auto start = chrono::steady_clock::now();
+    for (int i = 0; i < repeats; ++i) {
+        function();
+    }
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / repeats;
+}
+
+// Plus-word accumulation and minus-word exclusion: ConcurrentMap against the posting kernels
+// and the dense accumulator. The kernels must produce exactly the scores of the dense
+// accumulator
+bool BenchPostingKernels() {
+    const int universe = 1'000'000;
+    struct Distribution {
+        string name;
+        vector<int> plus_sizes;
+        vector<int> minus_sizes;
+    };
+    const vector<Distribution> distributions = {
+        { "uniform"s, { 100'000, 100'000, 100'000, 100'000 }, { 100'000, 100'000 } },
+        { "skewed"s, { 500'000, 50'000, 5'000, 500 }, { 200'000, 1'000 } },
+    };
+    cout << "distribution\tconcurrent_map_ms\tdense_accumulator_ms\tkernel_ms\tmismatches"s << endl;
+    mt19937 generator(7);
+    size_t total_mismatch_count = 0;
+    for (const auto& distribution : distributions) {
+        vector<ScoredOrdinals> plus_lists;
+        for (const int size : distribution.plus_sizes) {
+            plus_lists.push_back(MakeScoredOrdinals(generator, universe, size));
+        }
+        vector<vector<int>> minus_lists;
+        for (const int size : distribution.minus_sizes) {
+            minus_lists.push_back(MakeScoredOrdinals(generator, universe, size).ordinals);
+        }
+
+        size_t map_size = 0;
+        const double map_ms = MeasureMs([&] {
+            ConcurrentMap<int, double> document_to_relevance(500);
+            for (const auto& list : plus_lists) {
+                for (size_t i = 0; i < list.ordinals.size(); ++i) {
+                    document_to_relevance[list.ordinals[i]].ref_to_value += list.scores[i];
+                }
+            }
+            for (const auto& list : minus_lists) {
+                for (const int ordinal : list) {
+                    document_to_relevance.erase(ordinal);
+                }
+            }
+            map_size = document_to_relevance.BuildOrdinaryMap().size();
+        }, 3);
+
+        ScoreAccumulator accumulator;
+        const double accumulator_ms = MeasureMs([&] {
+            accumulator.Reset(0, universe);
+            for (const auto& list : plus_lists) {
+                for (size_t i = 0; i < list.ordinals.size(); ++i) {
+                    accumulator.Add(list.ordinals[i], list.scores[i]);
+                }
+            }
+            for (const auto& list : minus_lists) {
+                for (const int ordinal : list) {
+                    accumulator.Exclude(ordinal);
+                }
+            }
+        }, 10);
+        // the reference result, in ordinal order like the kernels produce it
+        vector<pair<int, double>> expected;
+        accumulator.ForEach([&expected](int ordinal, double score) { expected.emplace_back(ordinal, score); });
+        sort(expected.begin(), expected.end());
+
+        ScoredOrdinals candidates;
+        const double kernel_ms = MeasureMs([&] {
+            candidates = plus_lists.front();
+            for (size_t i = 1; i < plus_lists.size(); ++i) {
+                candidates = UnionScores(candidates, plus_lists[i]);
+            }
+            for (const auto& list : minus_lists) {
+                DifferenceScores(candidates, list);
+            }
+        }, 10);
+        size_t mismatch_count = candidates.ordinals.size() != expected.size() || map_size != expected.size();
+        for (size_t i = 0; i < min(candidates.ordinals.size(), expected.size()); ++i) {
+            mismatch_count += candidates.ordinals[i] != expected[i].first || candidates.scores[i] != expected[i].second;
+        }
+        cout << distribution.name << '\t' << map_ms << '\t' << accumulator_ms << '\t' << kernel_ms
+            << '\t' << mismatch_count << endl;
+        total_mismatch_count += mismatch_count;
+    }
+    return total_mismatch_count == 0;
+}
+
+bool HaveSameResults(const vector<Document>& lhs, const vector<Document>& rhs) {
+    return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& a, const Document& b) {
+        return a.id == b.id && a.rating == b.rating && abs(a.relevance - b.relevance) < 1e-12;
+    });
+}
+
+// Block-Max WAND against exhaustive evaluation of the same TF-IDF index: over documents of
+// varied length and status with tombstoned removals, every query must find the same
+// documents with the same relevance, whatever the filter, policy and top size
+bool BenchQueryEvaluation() {
+    const int vocabulary_size = 10'000;
+    const int document_count = 100'000;
+    const int query_count = 2'000;
+    mt19937 generator(53);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    uniform_int_distribution<int> words_per_document(5, 40);
+    uniform_int_distribution<int> rating(-5, 5);
+    discrete_distribution<int> status_index({ 85, 10, 4, 1 });
+    SearchServer search_server("and with"s);
+    for (int id = 0; id < document_count; ++id) {
+        string text;
+        for (int i = words_per_document(generator); i > 0; --i) {
+            text += MakeWord(word_index(generator) / (1 + i % 4));
+            text += ' ';
+        }
+        search_server.AddDocument(id, text, static_cast<DocumentStatus>(status_index(generator)), { rating(generator) });
+    }
+    for (int id = 0; id < document_count; id += 17) {
+        search_server.RemoveDocument(id);
+    }
+    vector<string> queries(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        string& query = queries[i];
+        for (int j = i % 4; j >= 0; --j) {
+            query += MakeWord(word_index(generator) / (j == 0 ? 50 : 1)) + " "s;
+        }
+        query += i % 3 == 0 ? "and "s : ""s;
+        query += i % 2 == 0 ? "-"s + MakeWord(word_index(generator) / 5) : ""s;
+    }
+
+    const auto run = [&](const string& query) {
+        array<vector<Document>, 5> results;
+        results[0] = search_server.FindTopDocuments(query);
+        results[1] = search_server.FindTopDocuments(query, DocumentStatus::BANNED);
+        results[2] = search_server.FindTopDocuments(query, [](int document_id, DocumentStatus status, int rating) {
+            return document_id % 3 == 0 && rating > 0;
+        });
+        results[3] = search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL);
+        results[4] = search_server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, 50);
+        return results;
+    };
+    vector<array<vector<Document>, 5>> pruned_results(query_count);
+    size_t mismatch_count = 0;
+    cout << "evaluation\tus_per_query"s << endl;
+    for (const QueryEvaluation evaluation : { QueryEvaluation::DYNAMIC_PRUNING, QueryEvaluation::EXHAUSTIVE }) {
+        search_server.SetQueryEvaluation(evaluation);
+        const double ms = MeasureMs([&] {
+            for (const string& query : queries) {
+                search_server.FindTopDocuments(query);
+            }
+        }, 3);
+        for (int i = 0; i < query_count; ++i) {
+            if (evaluation == QueryEvaluation::DYNAMIC_PRUNING) {
+                pruned_results[i] = run(queries[i]);
+                continue;
+            }
+            const auto results = run(queries[i]);
+            for (size_t j = 0; j < results.size(); ++j) {
+                mismatch_count += !HaveSameResults(pruned_results[i][j], results[j]);
+            }
+        }
+        cout << (evaluation == QueryEvaluation::DYNAMIC_PRUNING ? "wand"s : "exhaustive"s) << '\t' << ms * 1000.0 / query_count << endl;
+    }
+    cout << "mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// A top size beyond any corpus, such as SIZE_MAX, must return every match instead of
+// reserving room for top_k documents up front
+bool BenchHugeTopK() {
+    const int document_count = 1'000;
+    SearchServer search_server("and with"s);
+    ShardedSearchServer sharded_server("and with"sv, 3);
+    SegmentedSearchServer segmented_server("and with"s, 64);
+    for (int id = 0; id < document_count; ++id) {
+        const string text = (id % 3 == 0 ? "cat "s : "dog "s) + MakeWord(id % 50);
+        const auto status = static_cast<DocumentStatus>(id % 4);
+        search_server.AddDocument(id, text, status, { id % 7 - 3 });
+        sharded_server.AddDocument(id, text, status, { id % 7 - 3 });
+        segmented_server.AddDocument(id, text, status, { id % 7 - 3 });
+    }
+    segmented_server.Flush();
+
+    size_t mismatch_count = 0;
+    try {
+        for (const QueryEvaluation evaluation : { QueryEvaluation::DYNAMIC_PRUNING, QueryEvaluation::EXHAUSTIVE }) {
+            search_server.SetQueryEvaluation(evaluation);
+            const auto expected = search_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, document_count);
+            mismatch_count += expected.empty();
+            mismatch_count += !HaveSameResults(search_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, SIZE_MAX), expected);
+            mismatch_count += !HaveSameResults(
+                search_server.FindTopDocuments(execution::par, "cat"s, DocumentStatus::ACTUAL, SIZE_MAX), expected);
+            mismatch_count += !HaveSameResults(sharded_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, SIZE_MAX), expected);
+            mismatch_count += !HaveSameResults(segmented_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, SIZE_MAX), expected);
+        }
+    }
+    catch (const exception& e) {
+        cout << "huge_top_k\t"s << e.what() << endl;
+        return false;
+    }
+    cout << "huge_top_k_mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// ShardedSearchServer against one SearchServer holding the same documents: with the
+// corpus statistics gathered from every shard, queries must rank exactly like the single
+// index for any shard count, also after removals
+bool BenchShardedSearchServer() {
+    const int vocabulary_size = 20'000;
+    const int document_count = 60'000;
+    const int words_per_document = 15;
+    const int query_count = 1'000;
+    mt19937 generator(59);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    vector<string> texts(document_count);
+    vector<DocumentToAdd> documents;
+    for (int id = 0; id < document_count; ++id) {
+        for (int i = 0; i < words_per_document; ++i) {
+            texts[id] += MakeWord(word_index(generator) / (1 + i % 3));
+            texts[id] += ' ';
+        }
+        documents.push_back({ id, texts[id], static_cast<DocumentStatus>(id % 4 == 3 ? 2 : 0), { id % 11 - 5 } });
+    }
+    vector<string> queries(query_count);
+    for (string& query : queries) {
+        query = MakeWord(word_index(generator) / 10) + " "s + MakeWord(word_index(generator)) + " -"s + MakeWord(word_index(generator));
+    }
+
+    SearchServer single_server("and with"s);
+    single_server.AddDocuments(documents);
+    for (int id = 0; id < document_count; id += 13) {
+        single_server.RemoveDocument(id);
+    }
+
+    size_t mismatch_count = 0;
+    cout << "shards\tsingle_us_per_query\tsharded_us_per_query"s << endl;
+    for (const size_t shard_count : { 1, 3, 8 }) {
+        ShardedSearchServer sharded_server("and with"sv, shard_count);
+        // one half in a batch, the other one document at a time
+        sharded_server.AddDocuments(vector<DocumentToAdd>(documents.begin(), documents.begin() + document_count / 2));
+        for (int id = document_count / 2; id < document_count; ++id) {
+            sharded_server.AddDocument(id, texts[id], documents[id].status, documents[id].ratings);
+        }
+        for (int id = 0; id < document_count; id += 13) {
+            sharded_server.RemoveDocument(id);
+        }
+        // a batch with an invalid document changes no shard, whichever shard it belongs to
+        const vector<vector<DocumentToAdd>> invalid_batches = {
+            { { document_count, texts[1], DocumentStatus::ACTUAL, {} }, { document_count + 1, "bad\x01word"sv, DocumentStatus::ACTUAL, {} } },
+            { { document_count, texts[1], DocumentStatus::ACTUAL, {} }, { document_count, texts[2], DocumentStatus::ACTUAL, {} } },
+            { { document_count, texts[1], DocumentStatus::ACTUAL, {} }, { 1, texts[2], DocumentStatus::ACTUAL, {} } },
+        };
+        for (const auto& batch : invalid_batches) {
+            try {
+                sharded_server.AddDocuments(batch);
+                ++mismatch_count;
+            }
+            catch (const invalid_argument&) {
+            }
+        }
+        mismatch_count += sharded_server.GetDocumentCount() != single_server.GetDocumentCount();
+
+        const double single_ms = MeasureMs([&] {
+            for (const string& query : queries) {
+                single_server.FindTopDocuments(query);
+            }
+        }, 1);
+        const double sharded_ms = MeasureMs([&] {
+            for (const string& query : queries) {
+                sharded_server.FindTopDocuments(query);
+            }
+        }, 1);
+        for (const string& query : queries) {
+            mismatch_count += !HaveSameResults(sharded_server.FindTopDocuments(query), single_server.FindTopDocuments(query));
+            mismatch_count += !HaveSameResults(sharded_server.FindTopDocuments(query, DocumentStatus::BANNED),
+                single_server.FindTopDocuments(query, DocumentStatus::BANNED));
+            const auto predicate = [](int document_id, DocumentStatus status, int rating) { return rating > 0; };
+            mismatch_count += !HaveSameResults(sharded_server.FindTopDocuments(query, predicate),
+                single_server.FindTopDocuments(query, predicate));
+        }
+        for (int id = 1; id < document_count; id += 997) {
+            if (id % 13 == 0) {
+                continue; // removed
+            }
+            mismatch_count += sharded_server.MatchDocument(queries[id % query_count], id)
+                != single_server.MatchDocument(queries[id % query_count], id);
+        }
+        cout << shard_count << '\t' << single_ms * 1000.0 / query_count << '\t' << sharded_ms * 1000.0 / query_count << endl;
+    }
+    cout << "mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// The streaming ProcessQueries against the batch one: whatever the window size and the
+// input, every query result must reach the sink in input order and equal the batch result.
+// A failing query is rethrown after the results before it are emitted in order
+bool BenchProcessQueriesStream() {
+    const int vocabulary_size = 20'000;
+    const int document_count = 50'000;
+    const int words_per_document = 15;
+    const int query_count = 5'000;
+    mt19937 generator(61);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    SearchServer search_server("and with"s);
+    for (int id = 0; id < document_count; ++id) {
+        string text;
+        for (int i = 0; i < words_per_document; ++i) {
+            text += MakeWord(word_index(generator) / (1 + i % 3));
+            text += ' ';
+        }
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 9 });
+    }
+    vector<string> queries(query_count);
+    string query_lines;
+    for (string& query : queries) {
+        query = MakeWord(word_index(generator) / 10) + " "s + MakeWord(word_index(generator)) + " -"s + MakeWord(word_index(generator));
+        query_lines += query + "\n"s;
+    }
+    vector<vector<Document>> expected;
+    const double batch_ms = MeasureMs([&] { expected = ProcessQueries(search_server, queries); }, 1);
+    const auto compare = [&expected](const vector<vector<Document>>& results) {
+        size_t mismatch_count = results.size() != expected.size();
+        for (size_t i = 0; i < min(results.size(), expected.size()); ++i) {
+            mismatch_count += !HaveSameResults(results[i], expected[i]);
+        }
+        return mismatch_count;
+    };
+
+    size_t mismatch_count = 0;
+    cout << "max_in_flight\tbatch_ms\tstream_ms"s << endl;
+    for (const size_t max_in_flight : { 0, 1, 3, 64 }) {
+        vector<vector<Document>> results;
+        const double stream_ms = MeasureMs([&] {
+            ProcessQueriesStream(search_server, queries.begin(), queries.end(),
+                [&results](vector<Document>&& documents) { results.push_back(move(documents)); }, max_in_flight);
+        }, 1);
+        mismatch_count += compare(results);
+        cout << max_in_flight << '\t' << batch_ms << '\t' << stream_ms << endl;
+    }
+
+    vector<vector<Document>> line_results;
+    istringstream input(query_lines);
+    ProcessQueriesStream(search_server, input, [&line_results](vector<Document>&& documents) {
+        line_results.push_back(move(documents));
+    });
+    mismatch_count += compare(line_results);
+
+    vector<Document> joined;
+    ProcessQueriesJoinedStream(search_server, queries.begin(), queries.end(), back_inserter(joined), 7);
+    mismatch_count += !HaveSameResults(joined, ProcessQueriesJoined(search_server, queries));
+
+    // a double minus is an invalid query
+    vector<string> failing_queries(queries.begin(), queries.begin() + 100);
+    failing_queries[60] = "--"s + MakeWord(1);
+    vector<vector<Document>> partial_results;
+    bool has_thrown = false;
+    try {
+        ProcessQueriesStream(search_server, failing_queries.begin(), failing_queries.end(),
+            [&partial_results](vector<Document>&& documents) { partial_results.push_back(move(documents)); }, 8);
+    }
+    catch (const invalid_argument&) {
+        has_thrown = true;
+    }
+    mismatch_count += !has_thrown || partial_results.size() != 60;
+    for (size_t i = 0; i < min<size_t>(partial_results.size(), 60); ++i) {
+        mismatch_count += !HaveSameResults(partial_results[i], expected[i]);
+    }
+    cout << "mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// Startup by replaying AddDocument against loading a snapshot, and a round trip check:
+// the loaded index must answer queries exactly like the saved one, also after removals
+bool BenchSnapshot() {
+    const int vocabulary_size = 50'000;
+    const int document_count = 200'000;
+    const int words_per_document = 20;
+    mt19937 generator(7);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    vector<string> texts(document_count);
+    for (string& text : texts) {
+        for (int i = 0; i < words_per_document; ++i) {
+            text += MakeWord(word_index(generator));
+            text += ' ';
+        }
+    }
+    vector<string> queries;
+    for (int i = 0; i < 1'000; ++i) {
+        queries.push_back(MakeWord(word_index(generator)) + " "s + MakeWord(word_index(generator)) + " -"s + MakeWord(word_index(generator)));
+    }
+
+    SearchServer search_server("and with"s);
+    const double build_ms = MeasureMs([&] {
+        for (int id = 0; id < document_count; ++id) {
+            search_server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 4), { id % 7, 3 });
+        }
+    }, 1);
+    const string path = (filesystem::temp_directory_path() / "search_server_bench.snapshot").string();
+    const double save_ms = MeasureMs([&] { search_server.SaveSnapshot(path); }, 1);
+    const auto file_size = filesystem::file_size(path);
+    vector<SearchServer> loaded;
+    const double load_ms = MeasureMs([&] { loaded.push_back(SearchServer::LoadSnapshot(path)); }, 1);
+    const double unverified_load_ms = MeasureMs([&] {
+        loaded.push_back(SearchServer::LoadSnapshot(path, SnapshotVerification::STRUCTURE));
+    }, 1);
+
+    size_t mismatch_count = 0;
+    const auto compare = [&] {
+        for (const string& query : queries) {
+            mismatch_count += !HaveSameResults(search_server.FindTopDocuments(query), loaded[0].FindTopDocuments(query));
+            mismatch_count += !HaveSameResults(search_server.FindTopDocuments(query, DocumentStatus::BANNED),
+                loaded[0].FindTopDocuments(query, DocumentStatus::BANNED));
+        }
+        mismatch_count += search_server.GetDocumentCount() != loaded[0].GetDocumentCount();
+    };
+    compare();
+    // lookups by id read the documents in the file, iterating builds the id map
+    for (int id = 3; id < document_count; id += 1'009) {
+        mismatch_count += search_server.GetWordFrequencies(id) != loaded[1].GetWordFrequencies(id);
+        mismatch_count += get<1>(search_server.MatchDocument(queries[0], id)) != get<1>(loaded[1].MatchDocument(queries[0], id));
+    }
+    mismatch_count += !equal(search_server.begin(), search_server.end(), loaded[1].begin(), loaded[1].end());
+    loaded.pop_back();
+    for (int id = 0; id < document_count; id += 97) {
+        search_server.RemoveDocument(id);
+        loaded[0].RemoveDocument(id);
+    }
+    compare();
+    mismatch_count += search_server.GetWordFrequencies(1) != loaded[0].GetWordFrequencies(1);
+    // a loaded index writes the words of its loaded documents straight from the mapped file
+    const string resaved_path = path + ".resaved"s;
+    loaded[0].SaveSnapshot(resaved_path);
+    loaded.push_back(SearchServer::LoadSnapshot(resaved_path));
+    filesystem::remove(resaved_path);
+    for (const string& query : queries) {
+        mismatch_count += !HaveSameResults(search_server.FindTopDocuments(query), loaded[1].FindTopDocuments(query));
+    }
+    for (int id = 1; id < document_count; id += 1'001) {
+        mismatch_count += search_server.GetWordFrequencies(id) != loaded[1].GetWordFrequencies(id);
+    }
+    filesystem::remove(path);
+
+    cout << "documents\tbuild_ms\tsave_ms\tload_ms\tunverified_load_ms\tsnapshot_mb\tmismatches"s << endl;
+    cout << document_count << '\t' << build_ms << '\t' << save_ms << '\t' << load_ms << '\t' << unverified_load_ms << '\t'
+        << file_size / (1024.0 * 1024.0) << '\t' << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// Documents per second through AddDocument one by one and through AddDocuments batches
+bool BenchIngestion() {
+    const int vocabulary_size = 100'000;
+    const int document_count = 200'000;
+    const int words_per_document = 30;
+    mt19937 generator(11);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    vector<DocumentToAdd> documents(document_count);
+    vector<string> texts(document_count);
+    size_t text_size = 0;
+    for (int id = 0; id < document_count; ++id) {
+        for (int i = 0; i < words_per_document; ++i) {
+            texts[id] += MakeWord(word_index(generator));
+            texts[id] += ' ';
+        }
+        text_size += texts[id].size();
+        documents[id] = { id, texts[id], static_cast<DocumentStatus>(id % 4), { id % 5, 1 } };
+    }
+
+    SearchServer one_by_one("and with"s);
+    const double one_by_one_ms = MeasureMs([&] {
+        for (const auto& document : documents) {
+            one_by_one.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+    }, 1);
+
+    cout << "batch_size\tdocs_per_s\tmb_per_s\tspeedup"s << endl;
+    const auto report = [&](size_t batch_size, double ms) {
+        cout << batch_size << '\t' << document_count / ms * 1000.0 << '\t'
+            << text_size / (1024.0 * 1024.0) / ms * 1000.0 << '\t' << one_by_one_ms / ms << endl;
+    };
+    report(1, one_by_one_ms);
+
+    size_t mismatch_count = 0;
+    for (const size_t batch_size : { 1'000, 10'000, 200'000 }) {
+        SearchServer batched("and with"s);
+        const double ms = MeasureMs([&] {
+            for (size_t begin = 0; begin < documents.size(); begin += batch_size) {
+                const auto end = documents.begin() + min(documents.size(), begin + batch_size);
+                batched.AddDocuments(vector<DocumentToAdd>(documents.begin() + begin, end));
+            }
+        }, 1);
+        report(batch_size, ms);
+        for (int i = 0; i < 200; ++i) {
+            const string query = MakeWord(word_index(generator)) + " "s + MakeWord(word_index(generator));
+            mismatch_count += !HaveSameResults(one_by_one.FindTopDocuments(query), batched.FindTopDocuments(query));
+        }
+        mismatch_count += one_by_one.GetWordFrequencies(document_count - 1) != batched.GetWordFrequencies(document_count - 1);
+    }
+    cout << "mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// SegmentedSearchServer against one SearchServer holding the same live documents. A
+// writer adds, removes and re-adds documents while the main thread keeps querying,
+// removals of flushed documents land while the background thread merges their segments.
+// Once everything is flushed and merged, every query must rank exactly like the single index
+bool BenchSegmentedSearchServer() {
+    const int vocabulary_size = 5'000;
+    const int document_count = 30'000;
+    const int words_per_document = 12;
+    const size_t flush_threshold = 256;
+    mt19937 generator(47);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    vector<string> texts(document_count);
+    for (string& text : texts) {
+        for (int i = 0; i < words_per_document; ++i) {
+            text += MakeWord(word_index(generator) / (1 + i % 3));
+            text += ' ';
+        }
+    }
+    vector<string> queries(2'000);
+    for (string& query : queries) {
+        query = MakeWord(word_index(generator) / 3) + " "s + MakeWord(word_index(generator)) + " -"s + MakeWord(word_index(generator));
+    }
+
+    SegmentedSearchServer segmented_server("and with"s, flush_threshold);
+    map<int, pair<string_view, int>> live_documents; // text and rating
+    atomic<bool> is_writing = true;
+    size_t removed_count = 0;
+    size_t readded_count = 0;
+    const auto start = chrono::steady_clock::now();
+    thread writer([&] {
+        const auto remove = [&](int id) {
+            if (live_documents.erase(id) > 0) {
+                segmented_server.RemoveDocument(id);
+                ++removed_count;
+            }
+        };
+        for (int id = 0; id < document_count; ++id) {
+            segmented_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { id % 7 });
+            live_documents.emplace(id, pair{ string_view(texts[id]), id % 7 });
+            if (id % 10 == 9) {
+                remove(id - 3); // still in the mutable segment
+            }
+            if (id >= 2'000 && id % 4 == 0) {
+                remove(id - 2'000); // flushed, possibly a part of the merge running right now
+            }
+            if (id >= 3'000 && id % 40 == 0 && live_documents.count(id - 3'000) == 0) {
+                // the id of a removed document comes back with another text
+                const string_view text = texts[(id * 7) % document_count];
+                segmented_server.AddDocument(id - 3'000, text, DocumentStatus::ACTUAL, { id % 5 });
+                live_documents.emplace(id - 3'000, pair{ text, id % 5 });
+                ++readded_count;
+            }
+        }
+        is_writing = false;
+    });
+    size_t concurrent_query_count = 0;
+    while (is_writing) {
+        segmented_server.FindTopDocuments(queries[concurrent_query_count % queries.size()]);
+        ++concurrent_query_count;
+    }
+    writer.join();
+    const double write_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    segmented_server.Flush();
+    segmented_server.WaitForMerges();
+
+    SearchServer single_server("and with"s);
+    for (const auto& [id, document] : live_documents) {
+        single_server.AddDocument(id, document.first, DocumentStatus::ACTUAL, { document.second });
+    }
+    size_t mismatch_count = segmented_server.GetDocumentCount() != single_server.GetDocumentCount();
+    for (const string& query : queries) {
+        mismatch_count += !HaveSameResults(segmented_server.FindTopDocuments(query), single_server.FindTopDocuments(query));
+    }
+
+    cout << "documents\tremoved\treadded\twrite_ms\tconcurrent_queries\tsegments\tmismatches"s << endl;
+    cout << segmented_server.GetDocumentCount() << '\t' << removed_count << '\t' << readded_count << '\t' << write_ms << '\t'
+        << concurrent_query_count << '\t' << segmented_server.GetSegmentCount() << '\t' << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// The former RemoveDuplicates, comparing documents by sets of word copies
+void RemoveDuplicatesByWordSets(SearchServer& search_server) {
+    vector<int> duplicate_ids;
+    set<set<string>> word_sets;
+    for (const int document_id : search_server) {
+        set<string> words;
+        for (const auto& [word, _] : search_server.GetWordFrequencies(document_id)) {
+            words.emplace(word);
+        }
+        if (!word_sets.insert(move(words)).second) {
+            cout << "Found duplicate document id "s << document_id << endl;
+            duplicate_ids.push_back(document_id);
+        }
+    }
+    for (const int document_id : duplicate_ids) {
+        search_server.RemoveDocument(document_id);
+    }
+}
+
+template <typename Function>
+string CaptureOutput(Function function) {
+    ostringstream output;
+    auto* const buffer = cout.rdbuf(output.rdbuf());
+    function();
+    cout.rdbuf(buffer);
+    return output.str();
+}
+
+// Fingerprint deduplication against the word set one on a corpus with planted exact
+// duplicates (words shuffled and repeated) and near duplicates (one word replaced).
+// Both must print the same; a similarity threshold of 1 must find the exact ones
+bool BenchRemoveDuplicates() {
+    const int vocabulary_size = 50'000;
+    const int document_count = 200'000;
+    const int words_per_document = 30;
+    mt19937 generator(17);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    vector<vector<int>> document_words;
+    int near_duplicate_count = 0;
+    for (int id = 0; id < document_count; ++id) {
+        if (id % 10 == 3) {
+            auto words = document_words[uniform_int_distribution<int>(0, id - 1)(generator)];
+            shuffle(words.begin(), words.end(), generator);
+            words.push_back(words.front());
+            document_words.push_back(move(words));
+        }
+        else if (id % 10 == 7) {
+            auto words = document_words[uniform_int_distribution<int>(0, id - 1)(generator)];
+            words[0] = word_index(generator);
+            document_words.push_back(move(words));
+            ++near_duplicate_count;
+        }
+        else {
+            vector<int> words(words_per_document);
+            generate(words.begin(), words.end(), [&] { return word_index(generator); });
+            document_words.push_back(move(words));
+        }
+    }
+    const auto make_server = [&] {
+        SearchServer server("and with"s);
+        for (int id = 0; id < document_count; ++id) {
+            string text;
+            for (const int word : document_words[id]) {
+                text += MakeWord(word);
+                text += ' ';
+            }
+            server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+        }
+        return server;
+    };
+
+    cout << "dedup\tms\tremoved"s << endl;
+    size_t mismatch_count = 0;
+    string reference_output;
+    const auto run = [&](const string& name, auto remove) {
+        auto server = make_server();
+        const int initial_count = server.GetDocumentCount();
+        string output;
+        const double ms = MeasureMs([&] { output = CaptureOutput([&] { remove(server); }); }, 1);
+        cout << name << '\t' << ms << '\t' << initial_count - server.GetDocumentCount() << endl;
+        return output;
+    };
+    reference_output = run("word_sets"s, RemoveDuplicatesByWordSets);
+    mismatch_count += run("fingerprints"s, RemoveDuplicates) != reference_output;
+    mismatch_count += run("minhash_1.0"s, [](SearchServer& server) { RemoveNearDuplicates(server, 1.0); }) != reference_output;
+    run("minhash_0.8"s, [](SearchServer& server) { RemoveNearDuplicates(server, 0.8); });
+    cout << "planted_near_duplicates\t"s << near_duplicate_count << endl;
+    cout << "mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// Zipf-distributed query traffic (a few queries make up most requests, written with
+// the words in varying order) without and with the result cache. Cached results must
+// equal the uncached ones, also right after the index changes
+bool BenchQueryCache() {
+    const int vocabulary_size = 20'000;
+    const int document_count = 100'000;
+    const int words_per_document = 20;
+    const int distinct_query_count = 20'000;
+    const int request_count = 200'000;
+    mt19937 generator(23);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    SearchServer search_server("and with"s);
+    for (int id = 0; id < document_count; ++id) {
+        string text;
+        for (int i = 0; i < words_per_document; ++i) {
+            text += MakeWord(word_index(generator));
+            text += ' ';
+        }
+        search_server.AddDocument(id, text, static_cast<DocumentStatus>(id % 4), { id % 7 });
+    }
+    vector<array<string, 3>> distinct_queries(distinct_query_count);
+    for (auto& words : distinct_queries) {
+        words = { MakeWord(word_index(generator)), MakeWord(word_index(generator)), "-"s + MakeWord(word_index(generator)) };
+    }
+    vector<double> weights(distinct_query_count);
+    for (int rank = 0; rank < distinct_query_count; ++rank) {
+        weights[rank] = 1.0 / (rank + 1);
+    }
+    discrete_distribution<int> query_rank(weights.begin(), weights.end());
+    vector<string> requests(request_count);
+    for (string& request : requests) {
+        auto words = distinct_queries[query_rank(generator)];
+        shuffle(words.begin(), words.end(), generator);
+        request = words[0] + " "s + words[1] + " "s + words[2];
+    }
+
+    vector<vector<Document>> expected(request_count);
+    const double uncached_ms = MeasureMs([&] {
+        for (int i = 0; i < request_count; ++i) {
+            expected[i] = search_server.FindTopDocuments(requests[i]);
+        }
+    }, 1);
+    QueryResultCache cache(search_server, 16 << 20);
+    size_t mismatch_count = 0;
+    const double cached_ms = MeasureMs([&] {
+        for (int i = 0; i < request_count; ++i) {
+            mismatch_count += !HaveSameResults(cache.FindTopDocuments(requests[i]), expected[i]);
+        }
+    }, 1);
+    const auto statistics = cache.GetStatistics();
+    cout << "cache\trequests_per_s\thit_rate\tentries\tmemory_kb\tevictions"s << endl;
+    cout << "off\t"s << request_count / uncached_ms * 1000.0 << "\t0\t0\t0\t0"s << endl;
+    cout << "on\t"s << request_count / cached_ms * 1000.0 << '\t' << statistics.hits * 1.0 / request_count << '\t'
+        << statistics.entry_count << '\t' << statistics.memory_usage / 1024 << '\t' << statistics.evictions << endl;
+
+    search_server.RemoveDocument(expected[0].empty() ? 0 : expected[0].front().id);
+    search_server.AddDocument(document_count, requests[1], DocumentStatus::ACTUAL, { 1 });
+    for (int i = 0; i < 1'000; ++i) {
+        mismatch_count += !HaveSameResults(cache.FindTopDocuments(requests[i]), search_server.FindTopDocuments(requests[i]));
+    }
+    cout << "mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// The former tokenizer: SplitIntoWords by find_first_not_of/find, then a second scan
+// of every word for control characters
+bool SplitIntoWordsByFind(string_view text, vector<string_view>& words) {
+    words.clear();
+    for (size_t position = text.find_first_not_of(' '); position != text.npos;) {
+        const size_t space = text.find(' ', position);
+        words.push_back(text.substr(position, space == text.npos ? text.npos : space - position));
+        position = space == text.npos ? space : text.find_first_not_of(' ', space);
+    }
+    return all_of(words.begin(), words.end(), [](string_view word) {
+        return none_of(word.begin(), word.end(), [](char c) { return c >= '\0' && c < ' '; });
+    });
+}
+
+bool HaveSameWords(const vector<string_view>& lhs, const vector<string_view>& rhs) {
+    return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](string_view a, string_view b) {
+        return a.data() == b.data() && a.size() == b.size();
+    });
+}
+
+// Tokenizer throughput of every instruction set against the former tokenizer, and a
+// check that all of them split random texts with spaces, control and non-ASCII bytes
+// at every position into the same words
+bool BenchTokenizer() {
+    mt19937 generator(31);
+    string text;
+    const size_t text_size = 64 << 20;
+    while (text.size() < text_size) {
+        text.append(uniform_int_distribution<int>(1, 3)(generator), ' ');
+        const int word_size = uniform_int_distribution<int>(1, 12)(generator);
+        for (int i = 0; i < word_size; ++i) {
+            text += static_cast<char>('a' + generator() % 26);
+        }
+    }
+    vector<string_view> expected;
+    vector<string_view> words;
+    size_t mismatch_count = 0;
+    const double reference_ms = MeasureMs([&] { SplitIntoWordsByFind(text, expected); }, 3);
+    cout << "tokenizer\tmb_per_s\tspeedup"s << endl;
+    cout << "find\t"s << text.size() / (1024.0 * 1024.0) / reference_ms * 1000.0 << "\t1"s << endl;
+
+    const string alphabet = "ab  \t\n\x01\xC3\xA9"s;
+    for (const TokenizerIsa isa : { TokenizerIsa::SCALAR, TokenizerIsa::SSE2, TokenizerIsa::AVX2 }) {
+        SetTokenizerIsa(isa);
+        if (GetTokenizerIsa() != isa) {
+            continue;
+        }
+        const double ms = MeasureMs([&] { TokenizeWords(text, words); }, 3);
+        mismatch_count += !HaveSameWords(words, expected);
+        cout << GetTokenizerIsaName(isa) << '\t' << text.size() / (1024.0 * 1024.0) / ms * 1000.0 << '\t' << reference_ms / ms << endl;
+
+        for (int i = 0; i < 20'000; ++i) {
+            string sample(uniform_int_distribution<int>(0, 100)(generator), ' ');
+            for (char& c : sample) {
+                c = alphabet[generator() % alphabet.size()];
+            }
+            const bool expected_valid = SplitIntoWordsByFind(sample, expected);
+            mismatch_count += TokenizeWords(sample, words) != expected_valid || !HaveSameWords(words, expected);
+        }
+        SplitIntoWordsByFind(text, expected);
+    }
+    SetTokenizerIsa(TokenizerIsa::AVX2);
+    cout << "mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// Status-only queries, compiled to per-status bitmap tests, against the same filter
+// written as a lambda, which reads the status column. Rare statuses gain the most:
+// Block-Max WAND skips the documents up to the next one with the status
+bool BenchStatusFilter() {
+    const int vocabulary_size = 20'000;
+    const int document_count = 200'000;
+    const int words_per_document = 20;
+    mt19937 generator(37);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    discrete_distribution<int> status_index({ 85, 10, 4, 1 });
+    SearchServer search_server("and with"s);
+    for (int id = 0; id < document_count; ++id) {
+        string text;
+        for (int i = 0; i < words_per_document; ++i) {
+            text += MakeWord(word_index(generator));
+            text += ' ';
+        }
+        search_server.AddDocument(id, text, static_cast<DocumentStatus>(status_index(generator)), { id % 7 });
+    }
+    vector<string> queries;
+    for (int i = 0; i < 2'000; ++i) {
+        queries.push_back(MakeWord(word_index(generator) / 20) + " "s + MakeWord(word_index(generator) / 20) + " "s
+            + MakeWord(word_index(generator)));
+    }
+
+    cout << "status\tbitmap_us_per_query\tlambda_us_per_query"s << endl;
+    size_t mismatch_count = 0;
+    for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED, DocumentStatus::REMOVED }) {
+        vector<vector<Document>> bitmap_results(queries.size());
+        const double bitmap_ms = MeasureMs([&] {
+            for (size_t i = 0; i < queries.size(); ++i) {
+                bitmap_results[i] = search_server.FindTopDocuments(queries[i], status);
+            }
+        }, 1);
+        vector<vector<Document>> lambda_results(queries.size());
+        const double lambda_ms = MeasureMs([&] {
+            for (size_t i = 0; i < queries.size(); ++i) {
+                lambda_results[i] = search_server.FindTopDocuments(queries[i], [status](int document_id, DocumentStatus document_status, int rating) {
+                    return document_status == status;
+                });
+            }
+        }, 1);
+        for (size_t i = 0; i < queries.size(); ++i) {
+            mismatch_count += !HaveSameResults(bitmap_results[i], lambda_results[i]);
+        }
+        cout << static_cast<int>(status) << '\t' << bitmap_ms * 1000.0 / queries.size() << '\t' << lambda_ms * 1000.0 / queries.size() << endl;
+    }
+    cout << "mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// The counters of the ring buffer must match a deque of the window filled by one thread,
+// and after concurrent producers finish the window holds exactly the last requests
+bool BenchRequestQueue() {
+    const size_t window_size = RequestQueue::MIN_IN_DAY;
+    const int request_count = 2'000'000;
+    const SearchServer search_server("and with"s);
+    mt19937 generator(29);
+    bernoulli_distribution is_empty(0.3);
+    vector<size_t> result_counts(request_count);
+    for (size_t& result_count : result_counts) {
+        result_count = is_empty(generator) ? 0 : 1;
+    }
+
+    size_t mismatch_count = 0;
+    RequestQueue request_queue(search_server, window_size);
+    deque<size_t> expected_window;
+    int expected_no_result_count = 0;
+    for (int i = 0; i < 100'000; ++i) {
+        request_queue.RecordRequest(result_counts[i], chrono::microseconds(i % 1000));
+        expected_window.push_back(result_counts[i]);
+        expected_no_result_count += result_counts[i] == 0;
+        if (expected_window.size() > window_size) {
+            expected_no_result_count -= expected_window.front() == 0;
+            expected_window.pop_front();
+        }
+        mismatch_count += request_queue.GetNoResultRequests() != expected_no_result_count
+            || request_queue.GetRequestCount() != static_cast<int>(expected_window.size());
+    }
+    mismatch_count += request_queue.GetLatencyHistogram().GetTotalCount() != window_size;
+
+    cout << "producers\trequests_per_s"s << endl;
+    for (const int producer_count : { 1, 2, 4, 8 }) {
+        RequestQueue concurrent_queue(search_server, window_size);
+        const double ms = MeasureMs([&] {
+            vector<thread> producers;
+            for (int producer = 0; producer < producer_count; ++producer) {
+                producers.emplace_back([&, producer] {
+                    for (int i = producer; i < request_count; i += producer_count) {
+                        concurrent_queue.RecordRequest(0, chrono::microseconds(10));
+                    }
+                });
+            }
+            for (auto& producer : producers) {
+                producer.join();
+            }
+        }, 1);
+        mismatch_count += concurrent_queue.GetNoResultRequests() != static_cast<int>(window_size)
+            || concurrent_queue.GetLatencyHistogram().counts[4] != window_size;
+        cout << producer_count << '\t' << request_count / ms * 1000.0 << endl;
+    }
+
+    RequestQueue time_queue(search_server, chrono::milliseconds(200), 20);
+    for (int i = 0; i < 1'000; ++i) {
+        time_queue.RecordRequest(result_counts[i], chrono::microseconds(100));
+    }
+    mismatch_count += time_queue.GetRequestCount() != 1'000
+        || time_queue.GetNoResultRequests() != static_cast<int>(count(result_counts.begin(), result_counts.begin() + 1'000, 0));
+    this_thread::sleep_for(chrono::milliseconds(250));
+    mismatch_count += time_queue.GetRequestCount() != 0;
+    cout << "mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// Every query must record each of its phases once. Also prints where the time of a
+// query goes and what one phase timer costs
+bool BenchMetrics() {
+    const int vocabulary_size = 20'000;
+    const int document_count = 100'000;
+    const int words_per_document = 20;
+    const int query_count = 2'000;
+    mt19937 generator(31);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    SearchServer search_server("and with"s);
+    vector<DocumentToAdd> documents(document_count);
+    vector<string> texts(document_count);
+    for (int id = 0; id < document_count; ++id) {
+        for (int i = 0; i < words_per_document; ++i) {
+            texts[id] += MakeWord(word_index(generator));
+            texts[id] += ' ';
+        }
+        documents[id] = { id, texts[id], static_cast<DocumentStatus>(id % 4), { id % 7 } };
+    }
+    vector<string> queries(query_count);
+    for (string& query : queries) {
+        query = MakeWord(word_index(generator)) + " "s + MakeWord(word_index(generator)) + " -"s + MakeWord(word_index(generator));
+    }
+
+    const auto before = CollectMetrics();
+    search_server.AddDocuments(documents);
+    size_t mismatch_count = 0;
+    for (const auto evaluation : { QueryEvaluation::DYNAMIC_PRUNING, QueryEvaluation::EXHAUSTIVE }) {
+        search_server.SetQueryEvaluation(evaluation);
+        for (const string& query : queries) {
+            search_server.FindTopDocuments(execution::seq, query);
+        }
+    }
+    QueryResultCache cache(search_server, 1 << 20);
+    for (int i = 0; i < 2; ++i) {
+        cache.FindTopDocuments(queries.front());
+    }
+    const auto after = CollectMetrics();
+
+    const auto get_count = [&](MetricPhase phase) {
+        return after[phase].count - before[phase].count;
+    };
+    const auto get_counter = [&](MetricCounter counter) {
+        return after[counter] - before[counter];
+    };
+    const uint64_t expected_query_count = 2 * query_count + 1;
+#if SEARCH_SERVER_METRICS
+    mismatch_count += get_count(MetricPhase::PARSE) != expected_query_count + 2 // the keys of the cached requests
+        || get_count(MetricPhase::TERM_LOOKUP) != expected_query_count
+        || get_count(MetricPhase::SCORING) != expected_query_count
+        || get_count(MetricPhase::TOP_K) != expected_query_count
+        || get_count(MetricPhase::MINUS_FILTERING) != query_count + 1 // the cache miss runs exhaustive too
+        || get_counter(MetricCounter::DOCUMENTS_ADDED) != document_count
+        || get_counter(MetricCounter::CACHE_HITS) != 1
+        || get_counter(MetricCounter::CACHE_MISSES) != 1;
+#else
+    mismatch_count += get_count(MetricPhase::PARSE) != 0;
+#endif
+    cout << "phase\tcount\tmean_us\tp99_us"s << endl;
+    for (const auto phase : { MetricPhase::PARSE, MetricPhase::TERM_LOOKUP, MetricPhase::SCORING,
+        MetricPhase::MINUS_FILTERING, MetricPhase::TOP_K }) {
+        const uint64_t total_ns = after[phase].total_ns - before[phase].total_ns;
+        cout << GetMetricPhaseName(phase) << '\t' << get_count(phase) << '\t'
+            << (get_count(phase) == 0 ? 0.0 : total_ns * 1e-3 / get_count(phase)) << '\t'
+            << after[phase].GetPercentile(0.99) * 1e-3 << endl;
+    }
+    cout << "postings_scored_per_query\t"s << get_counter(MetricCounter::POSTINGS_SCORED) * 1.0 / expected_query_count << endl;
+
+    const int timer_count = 1'000'000;
+    const double timer_ms = MeasureMs([] {
+        for (int i = 0; i < timer_count; ++i) {
+            METRICS_TIME_PHASE(MATCH_DOCUMENT);
+        }
+    }, 1);
+    cout << "ns_per_phase_timer\t"s << timer_ms * 1e6 / timer_count << endl;
+    cout << "mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// MatchDocuments must agree with MatchDocument for every document of the batch
+bool BenchMatchDocuments() {
+    const int vocabulary_size = 5'000;
+    const int document_count = 200'000;
+    const int words_per_document = 20;
+    const int query_count = 200;
+    mt19937 generator(37);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    SearchServer search_server("and with"s);
+    for (int id = 0; id < document_count; ++id) {
+        string text;
+        for (int i = 0; i < words_per_document; ++i) {
+            text += MakeWord(word_index(generator));
+            text += ' ';
+        }
+        search_server.AddDocument(id, text, static_cast<DocumentStatus>(id % 4), { id % 7 });
+    }
+    vector<string> queries(query_count);
+    for (string& query : queries) {
+        for (int i = 0; i < 6; ++i) {
+            query += MakeWord(word_index(generator)) + " "s;
+        }
+        query += "-"s + MakeWord(word_index(generator)) + " -"s + MakeWord(word_index(generator));
+    }
+    uniform_int_distribution<int> document_id(0, document_count - 1);
+
+    size_t mismatch_count = 0;
+    cout << "batch\tone_by_one_us\tbatched_us\tbatched_par_us"s << endl;
+    for (const int batch_size : { 1, 50, 10'000 }) {
+        vector<vector<int>> batches(query_count);
+        for (auto& batch : batches) {
+            for (int i = 0; i < batch_size; ++i) {
+                batch.push_back(document_id(generator));
+            }
+        }
+        const int repeats = batch_size > 1'000 ? 1 : 20;
+        vector<vector<tuple<vector<string_view>, DocumentStatus>>> expected(query_count);
+        const double one_by_one_ms = MeasureMs([&] {
+            for (int q = 0; q < query_count; ++q) {
+                expected[q].clear();
+                for (const int id : batches[q]) {
+                    expected[q].push_back(search_server.MatchDocument(queries[q], id));
+                }
+            }
+        }, repeats);
+        vector<vector<tuple<vector<string_view>, DocumentStatus>>> batched(query_count);
+        const double batched_ms = MeasureMs([&] {
+            for (int q = 0; q < query_count; ++q) {
+                batched[q] = search_server.MatchDocuments(queries[q], batches[q]);
+            }
+        }, repeats);
+        vector<vector<tuple<vector<string_view>, DocumentStatus>>> batched_par(query_count);
+        const double batched_par_ms = MeasureMs([&] {
+            for (int q = 0; q < query_count; ++q) {
+                batched_par[q] = search_server.MatchDocuments(execution::par, queries[q], batches[q]);
+            }
+        }, repeats);
+        for (int q = 0; q < query_count; ++q) {
+            mismatch_count += batched[q] != expected[q] || batched_par[q] != expected[q];
+        }
+        cout << batch_size << '\t' << one_by_one_ms * 1000.0 / query_count << '\t' << batched_ms * 1000.0 / query_count
+            << '\t' << batched_par_ms * 1000.0 / query_count << endl;
+    }
+    cout << "mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// Precomputed IDF must depend only on the current documents, not on how the index got
+// there: an index grown one document at a time with removals and queries in between
+// has to rank like one built from the final documents in a single batch, also after
+// documents added later move the rounded document count to another step. Also prints
+// the term lookup cost and how far the tolerance moves relevance from the exact IDF
+bool BenchInverseDocumentFreqs() {
+    const int vocabulary_size = 20'000;
+    const int document_count = 100'000;
+    const int words_per_document = 20;
+    const int query_count = 5'000;
+    mt19937 generator(41);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    vector<string> texts(document_count);
+    for (string& text : texts) {
+        for (int i = 0; i < words_per_document; ++i) {
+            text += MakeWord(word_index(generator));
+            text += ' ';
+        }
+    }
+    vector<string> queries(query_count);
+    for (string& query : queries) {
+        query = MakeWord(word_index(generator)) + " "s + MakeWord(word_index(generator)) + " "s
+            + MakeWord(word_index(generator)) + " -"s + MakeWord(word_index(generator));
+    }
+
+    SearchServer incremental_server("and with"s);
+    incremental_server.SetInverseDocumentFreqTolerance(0.01);
+    vector<DocumentToAdd> live_documents;
+    for (int id = 0; id < document_count; ++id) {
+        incremental_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { id % 7 });
+        if (id % 10 == 9) {
+            incremental_server.RemoveDocument(id - 5);
+        }
+        if (id % 100 == 0) {
+            incremental_server.FindTopDocuments(queries[id % query_count]);
+        }
+    }
+    for (int id = 0; id < document_count; ++id) {
+        if (id % 10 != 4) {
+            live_documents.push_back({ id, texts[id], DocumentStatus::ACTUAL, { id % 7 } });
+        }
+    }
+    SearchServer batch_server("and with"s);
+    batch_server.SetInverseDocumentFreqTolerance(0.01);
+    batch_server.AddDocuments(live_documents);
+
+    // relative error of approximate results against exact ones, over the documents found by both
+    const auto get_max_error = [](const vector<Document>& results, const vector<Document>& exact_results) {
+        double max_error = 0.0;
+        for (size_t j = 0; j < min(results.size(), exact_results.size()); ++j) {
+            if (results[j].id == exact_results[j].id) {
+                max_error = max(max_error, abs(results[j].relevance / exact_results[j].relevance - 1.0));
+            }
+        }
+        return max_error;
+    };
+
+    size_t mismatch_count = 0;
+    for (const string& query : queries) {
+        mismatch_count += !HaveSameResults(incremental_server.FindTopDocuments(query), batch_server.FindTopDocuments(query));
+    }
+
+    cout << "tolerance\tterm_lookup_ns\tquery_us\tmax_relevance_error\tsame_top"s << endl;
+    batch_server.SetInverseDocumentFreqTolerance(0.0);
+    vector<vector<Document>> exact_results(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        exact_results[i] = batch_server.FindTopDocuments(queries[i]);
+    }
+    for (const double tolerance : { 0.0, 0.01, 0.1 }) {
+        batch_server.SetInverseDocumentFreqTolerance(tolerance);
+        batch_server.FindTopDocuments(queries.front());
+        vector<vector<Document>> results(query_count);
+        const auto before = CollectMetrics();
+        const double ms = MeasureMs([&] {
+            for (int i = 0; i < query_count; ++i) {
+                results[i] = batch_server.FindTopDocuments(queries[i]);
+            }
+        }, 1);
+        const auto after = CollectMetrics();
+        const auto& lookup_before = before[MetricPhase::TERM_LOOKUP];
+        const auto& lookup_after = after[MetricPhase::TERM_LOOKUP];
+        const uint64_t lookup_count = lookup_after.count - lookup_before.count;
+        double max_error = 0.0;
+        int same_top_count = 0;
+        for (int i = 0; i < query_count; ++i) {
+            same_top_count += results[i].size() == exact_results[i].size() && equal(results[i].begin(), results[i].end(),
+                exact_results[i].begin(), [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id; });
+            max_error = max(max_error, get_max_error(results[i], exact_results[i]));
+        }
+        cout << tolerance << '\t' << (lookup_count == 0 ? 0.0 : (lookup_after.total_ns - lookup_before.total_ns) * 1.0 / lookup_count)
+            << '\t' << ms * 1000.0 / query_count << '\t' << max_error << '\t' << same_top_count * 1.0 / query_count << endl;
+        // a relative bound only because no word is in nearly every document, see SetInverseDocumentFreqTolerance
+        mismatch_count += max_error > tolerance + 1e-12;
+    }
+
+    // 90'000 documents round to 90'112 for every tolerance above, growing by 3'000 at a
+    // time moves the count at tolerance 0.1 (steps of 8'192) across 98'304 and 106'496
+    // with a batch that stays within a step in between
+    const double growth_tolerance = 0.1;
+    const int growth_batch_size = 3'000;
+    batch_server.SetInverseDocumentFreqTolerance(growth_tolerance);
+    SearchServer exact_server("and with"s);
+    exact_server.AddDocuments(live_documents);
+    vector<string> growth_texts;
+    growth_texts.reserve(4 * growth_batch_size);
+    cout << "documents\tgrowth_max_relevance_error"s << endl;
+    for (int batch = 0; batch < 4; ++batch) {
+        vector<DocumentToAdd> added;
+        for (int i = 0; i < growth_batch_size; ++i) {
+            string& text = growth_texts.emplace_back();
+            for (int j = 0; j < words_per_document; ++j) {
+                text += MakeWord(word_index(generator));
+                text += ' ';
+            }
+            const int id = document_count + batch * growth_batch_size + i;
+            added.push_back({ id, text, DocumentStatus::ACTUAL, { id % 7 } });
+            live_documents.push_back(added.back());
+        }
+        batch_server.AddDocuments(added);
+        exact_server.AddDocuments(added);
+        SearchServer rebuilt_server("and with"s);
+        rebuilt_server.SetInverseDocumentFreqTolerance(growth_tolerance);
+        rebuilt_server.AddDocuments(live_documents);
+        double max_error = 0.0;
+        for (int i = 0; i < query_count; i += 5) {
+            const auto results = batch_server.FindTopDocuments(queries[i]);
+            mismatch_count += !HaveSameResults(results, rebuilt_server.FindTopDocuments(queries[i]));
+            max_error = max(max_error, get_max_error(results, exact_server.FindTopDocuments(queries[i])));
+        }
+        cout << batch_server.GetDocumentCount() << '\t' << max_error << endl;
+        mismatch_count += max_error > growth_tolerance + 1e-12;
+    }
+    cout << "mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+// Query latency of BM25 against TF-IDF over documents of varied length, both with
+// Block-Max WAND and exhaustively. For BM25 the pruned evaluation must find the same
+// documents as the exhaustive one, and a loaded snapshot must rank like the saved index
+bool BenchScorers() {
+    const int vocabulary_size = 20'000;
+    const int document_count = 200'000;
+    const int query_count = 2'000;
+    mt19937 generator(43);
+    uniform_int_distribution<int> word_index(0, vocabulary_size - 1);
+    uniform_int_distribution<int> words_per_document(5, 60);
+    vector<string> texts(document_count);
+    for (string& text : texts) {
+        for (int i = words_per_document(generator); i > 0; --i) {
+            text += MakeWord(word_index(generator) / (1 + i % 4));
+            text += ' ';
+        }
+    }
+    vector<DocumentToAdd> documents;
+    for (int id = 0; id < document_count; ++id) {
+        documents.push_back({ id, texts[id], DocumentStatus::ACTUAL, { id % 7 } });
+    }
+    vector<string> queries(query_count);
+    for (string& query : queries) {
+        query = MakeWord(word_index(generator) / 10) + " "s + MakeWord(word_index(generator)) + " "s
+            + MakeWord(word_index(generator)) + " -"s + MakeWord(word_index(generator));
+    }
+
+    SearchServer tf_idf_server("and with"s);
+    tf_idf_server.AddDocuments(documents);
+    BasicSearchServer<Bm25Scorer> bm25_server("and with"s);
+    bm25_server.AddDocuments(documents);
+
+    size_t mismatch_count = 0;
+    vector<vector<Document>> pruned_results(query_count);
+    cout << "evaluation\ttf_idf_us_per_query\tbm25_us_per_query"s << endl;
+    for (const QueryEvaluation evaluation : { QueryEvaluation::DYNAMIC_PRUNING, QueryEvaluation::EXHAUSTIVE }) {
+        tf_idf_server.SetQueryEvaluation(evaluation);
+        bm25_server.SetQueryEvaluation(evaluation);
+        tf_idf_server.FindTopDocuments(queries.front());
+        bm25_server.FindTopDocuments(queries.front());
+        vector<Document> results;
+        const double tf_idf_ms = MeasureMs([&] {
+            for (const string& query : queries) {
+                tf_idf_server.FindTopDocuments(execution::seq, query, DocumentStatusPredicate{ DocumentStatus::ACTUAL },
+                    MAX_RESULT_DOCUMENT_COUNT, results);
+            }
+        }, 3);
+        const double bm25_ms = MeasureMs([&] {
+            for (const string& query : queries) {
+                bm25_server.FindTopDocuments(execution::seq, query, DocumentStatusPredicate{ DocumentStatus::ACTUAL },
+                    MAX_RESULT_DOCUMENT_COUNT, results);
+            }
+        }, 3);
+        for (int i = 0; i < query_count; ++i) {
+            if (evaluation == QueryEvaluation::DYNAMIC_PRUNING) {
+                pruned_results[i] = bm25_server.FindTopDocuments(queries[i]);
+            }
+            else {
+                mismatch_count += !HaveSameResults(pruned_results[i], bm25_server.FindTopDocuments(queries[i]));
+            }
+        }
+        cout << (evaluation == QueryEvaluation::DYNAMIC_PRUNING ? "wand"s : "exhaustive"s) << '\t'
+            << tf_idf_ms * 1000.0 / query_count << '\t' << bm25_ms * 1000.0 / query_count << endl;
+    }
+
+    for (int id = 0; id < document_count; id += 13) {
+        bm25_server.RemoveDocument(id);
+    }
+    const string path = (filesystem::temp_directory_path() / "search_server_bench_bm25.snapshot").string();
+    bm25_server.SaveSnapshot(path);
+    const auto loaded = BasicSearchServer<Bm25Scorer>::LoadSnapshot(path);
+    filesystem::remove(path);
+    for (const string& query : queries) {
+        mismatch_count += !HaveSameResults(bm25_server.FindTopDocuments(query), loaded.FindTopDocuments(query));
+    }
+    cout << "mismatches\t"s << mismatch_count << endl;
+    return mismatch_count == 0;
+}
+
+}  // namespace
+
+// Without arguments runs the benchmark suite, "load [--option=value...]" runs the
+// load generator and prints its report as JSON
+int main(int argc, char* argv[]) {
+    if (argc > 1 && argv[1] == "load"s) {
+        try {
+            RunLoadGenerator(ParseLoadGeneratorOptions(argc - 2, argv + 2), cout);
+        }
+        catch (const invalid_argument& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+    BenchQueryLatencyByVocabulary();
+    const bool query_evaluation_ok = BenchQueryEvaluation();
+    const bool huge_top_k_ok = BenchHugeTopK();
+    const bool sharded_ok = BenchShardedSearchServer();
+    const bool process_queries_ok = BenchProcessQueriesStream();
+    const bool posting_kernels_ok = BenchPostingKernels();
+    const bool snapshot_ok = BenchSnapshot();
+    const bool ingestion_ok = BenchIngestion();
+    const bool segmented_ok = BenchSegmentedSearchServer();
+    const bool deduplication_ok = BenchRemoveDuplicates();
+    const bool cache_ok = BenchQueryCache();
+    const bool tokenizer_ok = BenchTokenizer();
+    const bool status_filter_ok = BenchStatusFilter();
+    const bool request_queue_ok = BenchRequestQueue();
+    const bool metrics_ok = BenchMetrics();
+    const bool match_documents_ok = BenchMatchDocuments();
+    const bool inverse_document_freqs_ok = BenchInverseDocumentFreqs();
+    const bool scorers_ok = BenchScorers();
+    return query_evaluation_ok && huge_top_k_ok && sharded_ok && process_queries_ok && posting_kernels_ok && snapshot_ok && ingestion_ok && segmented_ok && deduplication_ok && cache_ok && tokenizer_ok
+        && status_filter_ok && request_queue_ok && metrics_ok && match_documents_ok && inverse_document_freqs_ok
+        && scorers_ok ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+#include "segmented_search_server.h"
+
+#include <algorithm>
+
+SegmentedSearchServer::SegmentedSearchServer(const std::string& stop_words_text, size_t flush_threshold)
+    : SegmentedSearchServer(SplitIntoWords(stop_words_text), flush_threshold)
+{
+}
+
+SegmentedSearchServer::SegmentedSearchServer(const std::string_view stop_words_text, size_t flush_threshold)
+    : SegmentedSearchServer(SplitIntoWords(stop_words_text), flush_threshold)
+{
+}
+
+SegmentedSearchServer::~SegmentedSearchServer() {
+    {
+        std::lock_guard guard(write_mutex_);
+        stopping_ = true;
+    }
+    merge_needed_.notify_all();
+    merge_thread_.join();
+}
+
+void SegmentedSearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    std::lock_guard guard(write_mutex_);
+    if (document_id < 0 || document_segments_.count(document_id) > 0) {
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    mutable_segment_->AddDocument(document_id, document, status, ratings);
+    document_segments_.emplace(document_id, MUTABLE_SEGMENT_ID);
+    if (static_cast<size_t>(mutable_segment_->GetDocumentCount()) >= flush_threshold_) {
+        FlushLocked();
+    }
+}
+
+void SegmentedSearchServer::RemoveDocument(int document_id) {
+    std::lock_guard guard(write_mutex_);
+    const auto it = document_segments_.find(document_id);
+    if (it == document_segments_.end()) {
+        throw std::out_of_range("Invalid document_id"s);
+    }
+    if (it->second == MUTABLE_SEGMENT_ID) {
+        mutable_segment_->RemoveDocument(document_id);
+    }
+    else {
+        // the segment list is short, copying it copies a few pointers
+        auto snapshot = std::make_shared<Snapshot>(*GetSnapshot());
+        auto& segment = *std::find_if(snapshot->segments.begin(), snapshot->segments.end(),
+            [id = it->second](const Segment& segment) { return segment.id == id; });
+        auto tombstones = segment.tombstones ? std::make_shared<Tombstones>(*segment.tombstones)
+            : std::make_shared<Tombstones>(*segment.index);
+        tombstones->Remove(document_id, *segment.index);
+        segment.tombstones = std::move(tombstones);
+        Publish(std::move(snapshot));
+        merge_needed_.notify_one();
+    }
+    document_segments_.erase(it);
+}
+
+void SegmentedSearchServer::Flush() {
+    std::lock_guard guard(write_mutex_);
+    FlushLocked();
+}
+
+void SegmentedSearchServer::WaitForMerges() {
+    std::unique_lock lock(write_mutex_);
+    merge_done_.wait(lock, [this] { return !is_merging_ && PlanMerge(*GetSnapshot()).empty(); });
+}
+
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+    size_t top_k) const {
+    return FindTopDocuments(raw_query, DocumentStatusPredicate{ status }, top_k);
+}
+
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(const std::string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+int SegmentedSearchServer::GetDocumentCount() const {
+    int document_count = 0;
+    const auto snapshot = GetSnapshot();
+    for (const auto& segment : snapshot->segments) {
+        document_count += segment.index->GetDocumentCount();
+        if (segment.tombstones) {
+            document_count -= segment.tombstones->removed_count;
+        }
+    }
+    return document_count;
+}
+
+size_t SegmentedSearchServer::GetSegmentCount() const {
+    return GetSnapshot()->segments.size();
+}
+
+void SegmentedSearchServer::Start() {
+    mutable_segment_ = std::make_unique<SearchServer>(stop_words_);
+    snapshot_ = std::make_shared<const Snapshot>();
+    merge_thread_ = std::thread([this] { RunMerges(); });
+}
+
+std::shared_ptr<const SegmentedSearchServer::Snapshot> SegmentedSearchServer::GetSnapshot() const {
+    std::lock_guard guard(snapshot_mutex_);
+    return snapshot_;
+}
+
+void SegmentedSearchServer::Publish(std::shared_ptr<const Snapshot> snapshot) {
+    {
+        std::lock_guard guard(snapshot_mutex_);
+        snapshot_.swap(snapshot);
+    }
+    // the previous snapshot, if this was its last holder, is freed outside the lock
+}
+
+void SegmentedSearchServer::FlushLocked() {
+    if (mutable_segment_->GetDocumentCount() == 0) {
+        return;
+    }
+    // a segment is immutable once published, so this is the last chance to drop its removed postings
+    mutable_segment_->PurgeRemovedDocuments();
+    const uint64_t segment_id = next_segment_id_++;
+    for (const int document_id : *mutable_segment_) {
+        document_segments_[document_id] = segment_id;
+    }
+    auto snapshot = std::make_shared<Snapshot>(*GetSnapshot());
+    snapshot->segments.push_back({ segment_id, std::move(mutable_segment_), nullptr });
+    mutable_segment_ = std::make_unique<SearchServer>(stop_words_);
+    Publish(std::move(snapshot));
+    merge_needed_.notify_one();
+}
+
+std::vector<SegmentedSearchServer::Segment> SegmentedSearchServer::PlanMerge(const Snapshot& snapshot) {
+    const auto get_live_count = [](const Segment& segment) {
+        return segment.index->GetDocumentCount() - (segment.tombstones ? segment.tombstones->removed_count : 0);
+    };
+    if (snapshot.segments.size() > MAX_SEGMENT_COUNT) {
+        // merging the smallest segments keeps every document merged O(log N) times
+        std::vector<Segment> segments = snapshot.segments;
+        std::partial_sort(segments.begin(), segments.begin() + MERGE_FACTOR, segments.end(),
+            [&](const Segment& lhs, const Segment& rhs) { return get_live_count(lhs) < get_live_count(rhs); });
+        segments.resize(MERGE_FACTOR);
+        return segments;
+    }
+    // a segment that is mostly removed documents is rewritten alone
+    for (const auto& segment : snapshot.segments) {
+        if (segment.tombstones && segment.tombstones->removed_count * 2 > segment.index->GetDocumentCount()) {
+            return { segment };
+        }
+    }
+    return {};
+}
+
+void SegmentedSearchServer::RunMerges() {
+    std::unique_lock lock(write_mutex_);
+    while (true) {
+        std::vector<Segment> parts;
+        merge_needed_.wait(lock, [&] {
+            return stopping_ || !(parts = PlanMerge(*GetSnapshot())).empty();
+        });
+        if (stopping_) {
+            return;
+        }
+        is_merging_ = true;
+        lock.unlock();
+
+        // the parts are immutable, so merging needs no lock
+        auto merged = std::make_shared<SearchServer>(stop_words_);
+        for (const auto& part : parts) {
+            merged->MergeFrom(*part.index, part.tombstones ? part.tombstones->GetRemovedIds() : std::set<int>{});
+        }
+
+        lock.lock();
+        // documents removed from the parts while merging become tombstones of the merged segment
+        const uint64_t segment_id = next_segment_id_++;
+        auto snapshot = std::make_shared<Snapshot>();
+        std::shared_ptr<Tombstones> tombstones;
+        const auto current_snapshot = GetSnapshot();
+        for (const auto& segment : current_snapshot->segments) {
+            const auto part = std::find_if(parts.begin(), parts.end(),
+                [&](const Segment& part) { return part.id == segment.id; });
+            if (part == parts.end()) {
+                snapshot->segments.push_back(segment);
+                continue;
+            }
+            if (segment.tombstones == part->tombstones) {
+                continue;
+            }
+            for (const int document_id : segment.tombstones->GetRemovedIds()) {
+                if (part->tombstones && part->tombstones->IsRemoved(document_id)) {
+                    continue;
+                }
+                if (!tombstones) {
+                    tombstones = std::make_shared<Tombstones>(*merged);
+                }
+                tombstones->Remove(document_id, *merged);
+            }
+        }
+        for (const int document_id : *merged) {
+            auto it = document_segments_.find(document_id);
+            if (it != document_segments_.end() && std::any_of(parts.begin(), parts.end(),
+                [&](const Segment& part) { return part.id == it->second; })) {
+                it->second = segment_id;
+            }
+        }
+        if (merged->GetDocumentCount() > 0) {
+            snapshot->segments.push_back({ segment_id, std::move(merged), std::move(tombstones) });
+        }
+        Publish(std::move(snapshot));
+        is_merging_ = false;
+        merge_done_.notify_all();
+    }
+}
+
+SearchServer::CorpusStatistics SegmentedSearchServer::GatherQueryStatistics(const Snapshot& snapshot,
+    const std::string_view raw_query) const {
+    auto statistics = query_parser_.GetQueryStatistics(raw_query);
+    for (const auto& segment : snapshot.segments) {
+        const auto segment_statistics = segment.index->GetQueryStatistics(raw_query);
+        statistics.document_count += segment_statistics.document_count;
+        for (const auto& [word, document_freq] : segment_statistics.document_freqs) {
+            statistics.document_freqs[word] += document_freq;
+        }
+        if (segment.tombstones) {
+            statistics.document_count -= segment.tombstones->removed_count;
+            for (auto& [word, document_freq] : statistics.document_freqs) {
+                const int term_id = segment.index->FindTermId(word);
+                if (term_id != TermDictionary::NO_TERM) {
+                    document_freq -= segment.tombstones->document_freqs[term_id];
+                }
+            }
+        }
+    }
+    return statistics;
+}
+
+SegmentedSearchServer::Tombstones::Tombstones(const SearchServer& index)
+    : document_ids(std::make_shared<const std::vector<int>>(index.begin(), index.end()))
+    , removed((document_ids->size() + 63) / 64)
+    , document_freqs(index.GetTermCount())
+{
+}
+
+bool SegmentedSearchServer::Tombstones::IsRemoved(int document_id) const {
+    const auto it = std::lower_bound(document_ids->begin(), document_ids->end(), document_id);
+    if (it == document_ids->end() || *it != document_id) {
+        return false;
+    }
+    const size_t index = it - document_ids->begin();
+    return (removed[index / 64] >> (index % 64)) & 1;
+}
+
+void SegmentedSearchServer::Tombstones::Remove(int document_id, const SearchServer& index) {
+    const size_t position = std::lower_bound(document_ids->begin(), document_ids->end(), document_id) - document_ids->begin();
+    removed.GetMutable(position / 64) |= uint64_t{ 1 } << (position % 64);
+    for (const auto& [word, _] : index.GetWordFrequencies(document_id)) {
+        ++document_freqs.GetMutable(index.FindTermId(word));
+    }
+    ++removed_count;
+}
+
+std::set<int> SegmentedSearchServer::Tombstones::GetRemovedIds() const {
+    std::set<int> removed_ids;
+    for (size_t i = 0; i < document_ids->size(); ++i) {
+        if ((removed[i / 64] >> (i % 64)) & 1) {
+            removed_ids.emplace_hint(removed_ids.end(), (*document_ids)[i]);
+        }
+    }
+    return removed_ids;
+}
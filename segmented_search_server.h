@@ -0,0 +1,184 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "cow_array.h"
+#include "search_server.h"
+#include "string_processing.h"
+#include "thread_pool.h"
+
+// LSM-style index that keeps serving queries while documents are added and removed.
+// New documents go to a mutable segment owned by the writers. Flush, which runs by
+// itself every flush_threshold added documents, seals that segment into an immutable
+// one. Queries search the immutable segments of a published snapshot and always see
+// one consistent state; they lock a mutex only to copy the snapshot pointer, which
+// Publish swaps under the same mutex (the atomic shared_ptr functions are deprecated
+// and std::atomic<std::shared_ptr> needs C++20). Removing a document of an immutable
+// segment publishes a new snapshot whose tombstones for that segment share all but
+// the changed blocks with the previous version. A background thread merges small
+// segments and purges the tombstoned documents.
+// IDF is computed from the live documents of all segments, so a query ranks like
+// a single SearchServer holding the flushed documents.
+class SegmentedSearchServer {
+public:
+    static constexpr size_t DEFAULT_FLUSH_THRESHOLD = 4096;
+    static constexpr size_t MAX_SEGMENT_COUNT = 8;
+    static constexpr size_t MERGE_FACTOR = 4;
+
+    template <typename StringContainer>
+    explicit SegmentedSearchServer(const StringContainer& stop_words, size_t flush_threshold = DEFAULT_FLUSH_THRESHOLD);
+
+    explicit SegmentedSearchServer(const std::string& stop_words_text, size_t flush_threshold = DEFAULT_FLUSH_THRESHOLD);
+
+    explicit SegmentedSearchServer(const std::string_view stop_words_text, size_t flush_threshold = DEFAULT_FLUSH_THRESHOLD);
+
+    SegmentedSearchServer(const SegmentedSearchServer&) = delete;
+    SegmentedSearchServer& operator=(const SegmentedSearchServer&) = delete;
+
+    // Stops the merge thread, a merge in progress is finished first
+    ~SegmentedSearchServer();
+
+    // The document becomes visible to queries with the next Flush
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    // Makes every added document visible to queries
+    void Flush();
+
+    // Blocks until the background thread has nothing left to merge
+    void WaitForMerges();
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query,
+        DocumentPredicate document_predicate, size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+        size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
+
+    // Documents visible to queries
+    int GetDocumentCount() const;
+
+    size_t GetSegmentCount() const;
+
+private:
+    // Removed documents of one segment. A removal copies the tombstones of the segment,
+    // which shares the blocks of the bitmap and counts with the previous version
+    struct Tombstones {
+        std::shared_ptr<const std::vector<int>> document_ids; // of the segment, ascending
+        CowArray<uint64_t, 64> removed;  // bitmap by index in document_ids
+        CowArray<int> document_freqs;    // of the removed documents, by term id of the segment
+        int removed_count = 0;
+
+        explicit Tombstones(const SearchServer& index);
+
+        bool IsRemoved(int document_id) const;
+
+        // The document must be in the index and not removed yet
+        void Remove(int document_id, const SearchServer& index);
+
+        std::set<int> GetRemovedIds() const;
+    };
+
+    struct Segment {
+        uint64_t id = 0;
+        std::shared_ptr<const SearchServer> index;
+        std::shared_ptr<const Tombstones> tombstones; // null while nothing is removed
+    };
+
+    // Never modified once published, a change publishes a modified copy
+    struct Snapshot {
+        std::vector<Segment> segments;
+    };
+
+    static constexpr uint64_t MUTABLE_SEGMENT_ID = 0;
+
+    const std::set<std::string, std::less<>> stop_words_;
+    const size_t flush_threshold_;
+    const SearchServer query_parser_; // validates queries when there is no segment yet
+
+    mutable std::mutex snapshot_mutex_;
+    std::shared_ptr<const Snapshot> snapshot_; // guarded by snapshot_mutex_
+
+    // everything below is guarded by write_mutex_
+    std::mutex write_mutex_;
+    std::unique_ptr<SearchServer> mutable_segment_;
+    std::unordered_map<int, uint64_t> document_segments_;
+    uint64_t next_segment_id_ = MUTABLE_SEGMENT_ID + 1;
+    bool is_merging_ = false;
+    bool stopping_ = false;
+    std::condition_variable merge_needed_;
+    std::condition_variable merge_done_;
+    std::thread merge_thread_;
+
+    void Start();
+
+    std::shared_ptr<const Snapshot> GetSnapshot() const;
+
+    void Publish(std::shared_ptr<const Snapshot> snapshot);
+
+    void FlushLocked();
+
+    // Segments to merge next, empty if nothing needs merging
+    static std::vector<Segment> PlanMerge(const Snapshot& snapshot);
+
+    void RunMerges();
+
+    SearchServer::CorpusStatistics GatherQueryStatistics(const Snapshot& snapshot, const std::string_view raw_query) const;
+};
+
+template <typename StringContainer>
+SegmentedSearchServer::SegmentedSearchServer(const StringContainer& stop_words, size_t flush_threshold)
+    : stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+    , flush_threshold_(flush_threshold)
+    , query_parser_(stop_words_)
+{
+    if (flush_threshold_ == 0) {
+        throw std::invalid_argument("Flush threshold must be positive"s);
+    }
+    Start();
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(const std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t top_k) const {
+    // holding the snapshot keeps its segments alive even if they are merged meanwhile
+    const auto snapshot = GetSnapshot();
+    const auto statistics = GatherQueryStatistics(*snapshot, raw_query);
+    std::vector<std::future<std::vector<Document>>> segment_results;
+    for (const auto& segment : snapshot->segments) {
+        segment_results.push_back(ThreadPool::GetDefault().Submit([&] {
+            if (!segment.tombstones) {
+                return segment.index->FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_k, statistics);
+            }
+            const auto& tombstones = *segment.tombstones;
+            return segment.index->FindTopDocuments(std::execution::seq, raw_query,
+                [&](int document_id, DocumentStatus status, int rating) {
+                    return !tombstones.IsRemoved(document_id) && document_predicate(document_id, status, rating);
+                }, top_k, statistics);
+        }));
+    }
+    const auto results = ThreadPool::GetDefault().WaitAll(segment_results);
+    size_t candidate_count = 0;
+    for (const auto& documents : results) {
+        candidate_count += documents.size();
+    }
+    TopDocuments top(top_k, candidate_count);
+    for (const auto& documents : results) {
+        for (const auto& document : documents) {
+            top.Push(document);
+        }
+    }
+    return top.Release();
+}
@@ -0,0 +1,127 @@
+#include "sharded_search_server.h"
+
+#include <exception>
+#include <set>
+
+ShardedSearchServer::ShardedSearchServer(const std::string_view stop_words_text, size_t shard_count)
+    : ShardedSearchServer(SplitIntoWords(stop_words_text), shard_count)
+{
+}
+
+void ShardedSearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    if (document_id < 0) {
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    shards_[GetShardIndex(document_id)].AddDocument(document_id, document, status, ratings);
+    UpdateDocumentFreqs(document_id, 1);
+    ++statistics_.document_count;
+}
+
+void ShardedSearchServer::AddDocuments(const std::vector<DocumentToAdd>& documents) {
+    // the texts are checked in parallel, the errors are raised in batch order
+    std::vector<std::exception_ptr> errors(documents.size());
+    ThreadPool::GetDefault().ParallelFor(documents.size(), [&](const size_t i) {
+        if (documents[i].id < 0) {
+            return;
+        }
+        try {
+            shards_[GetShardIndex(documents[i].id)].CheckDocument(documents[i].id, documents[i].text);
+        }
+        catch (...) {
+            errors[i] = std::current_exception();
+        }
+    });
+    std::set<int> batch_ids;
+    std::vector<std::vector<DocumentToAdd>> shard_documents(shards_.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        if (documents[i].id < 0 || !batch_ids.insert(documents[i].id).second) {
+            throw std::invalid_argument("Invalid document_id"s);
+        }
+        if (errors[i]) {
+            std::rethrow_exception(errors[i]);
+        }
+        shard_documents[GetShardIndex(documents[i].id)].push_back(documents[i]);
+    }
+
+    std::vector<std::future<void>> shard_tasks;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        shard_tasks.push_back(ThreadPool::GetDefault().Submit([this, i, &shard_documents] {
+            shards_[i].AddDocuments(shard_documents[i]);
+        }));
+    }
+    ThreadPool::GetDefault().WaitAll(shard_tasks);
+    for (const auto& document : documents) {
+        UpdateDocumentFreqs(document.id, 1);
+    }
+    statistics_.document_count += static_cast<int>(documents.size());
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+    size_t top_k) const {
+    return FindTopDocuments(raw_query, DocumentStatusPredicate{ status }, top_k);
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(
+    const std::string_view raw_query, int document_id) const {
+    if (document_id < 0) {
+        throw std::out_of_range("Invalid document_id"s);
+    }
+    return shards_[GetShardIndex(document_id)].MatchDocument(raw_query, document_id);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    if (document_id < 0) {
+        throw std::out_of_range("Invalid document_id"s);
+    }
+    // the words of an unknown id are empty, RemoveDocument throws before the count changes
+    UpdateDocumentFreqs(document_id, -1);
+    shards_[GetShardIndex(document_id)].RemoveDocument(document_id);
+    --statistics_.document_count;
+}
+
+void ShardedSearchServer::PurgeRemovedDocuments() {
+    ThreadPool::GetDefault().ParallelFor(shards_.size(), [this](const size_t shard) {
+        shards_[shard].PurgeRemovedDocuments();
+    });
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    int document_count = 0;
+    for (const auto& shard : shards_) {
+        document_count += shard.GetDocumentCount();
+    }
+    return document_count;
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+void ShardedSearchServer::SetQueryEvaluation(QueryEvaluation query_evaluation) {
+    for (auto& shard : shards_) {
+        shard.SetQueryEvaluation(query_evaluation);
+    }
+}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+    return static_cast<size_t>(document_id) % shards_.size();
+}
+
+void ShardedSearchServer::UpdateDocumentFreqs(int document_id, int delta) {
+    auto& document_freqs = statistics_.document_freqs;
+    for (const auto& [word, _] : shards_[GetShardIndex(document_id)].GetWordFrequencies(document_id)) {
+        auto it = document_freqs.find(word);
+        if (it == document_freqs.end()) {
+            it = document_freqs.emplace(std::string(word), 0).first;
+        }
+        it->second += delta;
+        if (it->second == 0) {
+            document_freqs.erase(it);
+        }
+    }
+}
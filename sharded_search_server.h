@@ -0,0 +1,95 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "search_server.h"
+#include "thread_pool.h"
+
+// Documents are partitioned by id between shard_count independent SearchServer
+// indexes. A query fans out to every shard on the default ThreadPool and the shard
+// tops are merged. IDF is computed from the corpus statistics of all shards, which
+// are kept up to date on every add and removal, so the ranking is the same as that
+// of a single SearchServer holding every document.
+class ShardedSearchServer {
+public:
+    template <typename StringContainer>
+    ShardedSearchServer(const StringContainer& stop_words, size_t shard_count);
+
+    ShardedSearchServer(const std::string_view stop_words_text, size_t shard_count);
+
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+
+    // The whole batch is checked first, then every shard indexes its part in its own
+    // task. Throws like AddDocument would for the first invalid document of the batch;
+    // then no shard adds anything.
+    void AddDocuments(const std::vector<DocumentToAdd>& documents);
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query,
+        DocumentPredicate document_predicate, size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+        size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query,
+        int document_id) const;
+
+    void RemoveDocument(int document_id);
+
+    // SearchServer::PurgeRemovedDocuments on every shard, in parallel
+    void PurgeRemovedDocuments();
+
+    int GetDocumentCount() const;
+
+    size_t GetShardCount() const;
+
+    void SetQueryEvaluation(QueryEvaluation query_evaluation);
+
+private:
+    std::vector<SearchServer> shards_;
+    SearchServer::CorpusStatistics statistics_; // of every shard, words no document has are dropped
+
+    size_t GetShardIndex(int document_id) const;
+
+    // Adds delta, 1 or -1, to the document frequencies of the words of the document
+    void UpdateDocumentFreqs(int document_id, int delta);
+};
+
+template <typename StringContainer>
+ShardedSearchServer::ShardedSearchServer(const StringContainer& stop_words, size_t shard_count) {
+    if (shard_count == 0) {
+        throw std::invalid_argument("Shard count must be positive"s);
+    }
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.emplace_back(stop_words);
+    }
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t top_k) const {
+    std::vector<std::future<std::vector<Document>>> shard_results;
+    for (const auto& shard : shards_) {
+        shard_results.push_back(ThreadPool::GetDefault().Submit([&] {
+            return shard.FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_k, statistics_);
+        }));
+    }
+    const auto results = ThreadPool::GetDefault().WaitAll(shard_results);
+    size_t candidate_count = 0;
+    for (const auto& documents : results) {
+        candidate_count += documents.size();
+    }
+    TopDocuments top(top_k, candidate_count);
+    for (const auto& documents : results) {
+        for (const auto& document : documents) {
+            top.Push(document);
+        }
+    }
+    return top.Release();
+}
@@ -1,4 +1,9 @@
 #include "string_processing.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define STRING_PROCESSING_X86
+#include <immintrin.h>
+#endif
 /*
 std::vector<std::string_view> SplitIntoWords( std::string_view text) {
     std::vector<std::string_view> words;
@@ -21,26 +26,156 @@ std::vector<std::string_view> SplitIntoWords( std::string_view text) {
     return words;
 }
 */
-std::vector<std::string_view> SplitIntoWords(std::string_view str) {
-    std::vector<std::string_view> result;
-    int64_t pos = str.find_first_not_of(" ");
 
-    const int64_t pos_end = str.npos;
+namespace {
 
+// Words are the maximal runs of bytes other than ' ', exactly what the former
+// find_first_not_of/find loop of SplitIntoWords produced
+struct TokenizerState {
+    bool in_word = false; // whether the last byte seen belongs to a word
+    size_t word_begin = 0;
+    bool has_control = false;
+};
 
-    while (pos != pos_end) {
-        str.remove_prefix(pos);
-        int64_t space = str.find(' ');
+void TokenizeScalar(std::string_view text, size_t begin, TokenizerState& state, std::vector<std::string_view>& words) {
+    for (size_t i = begin; i < text.size(); ++i) {
+        const auto c = static_cast<unsigned char>(text[i]);
+        state.has_control |= c < ' ';
+        const bool is_word = c != ' ';
+        if (is_word == state.in_word) {
+            continue;
+        }
+        if (is_word) {
+            state.word_begin = i;
+        }
+        else {
+            words.push_back(text.substr(state.word_begin, i - state.word_begin));
+        }
+        state.in_word = is_word;
+    }
+}
 
-        result.push_back(str.substr(0, space));
+#ifdef STRING_PROCESSING_X86
 
-        if (space == pos_end) {
-            break;
+// Bit i of transitions marks byte block + i as the first byte of a word or the space
+// right after one
+void EmitWords(std::string_view text, size_t block, uint32_t transitions, TokenizerState& state,
+    std::vector<std::string_view>& words) {
+    while (transitions != 0) {
+        const size_t i = block + __builtin_ctz(transitions);
+        if (state.in_word) {
+            words.push_back(text.substr(state.word_begin, i - state.word_begin));
+        }
+        else {
+            state.word_begin = i;
         }
-        pos = str.find_first_not_of(" ", space);
+        state.in_word = !state.in_word;
+        transitions &= transitions - 1;
+    }
+}
 
+// Both return how many bytes they consumed, whole blocks only
+__attribute__((target("sse2")))
+size_t TokenizeSse2(std::string_view text, TokenizerState& state, std::vector<std::string_view>& words) {
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i last_control = _mm_set1_epi8(' ' - 1);
+    __m128i controls = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= text.size(); i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i));
+        // unsigned byte <= ' ' - 1
+        controls = _mm_or_si128(controls, _mm_cmpeq_epi8(_mm_min_epu8(bytes, last_control), bytes));
+        const uint32_t word_bytes = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, spaces))) & 0xFFFF;
+        EmitWords(text, i, (word_bytes ^ (word_bytes << 1 | state.in_word)) & 0xFFFF, state, words);
+    }
+    state.has_control |= _mm_movemask_epi8(controls) != 0;
+    return i;
+}
 
+__attribute__((target("avx2")))
+size_t TokenizeAvx2(std::string_view text, TokenizerState& state, std::vector<std::string_view>& words) {
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    const __m256i last_control = _mm256_set1_epi8(' ' - 1);
+    __m256i controls = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= text.size(); i += 32) {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + i));
+        controls = _mm256_or_si256(controls, _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, last_control), bytes));
+        const uint32_t word_bytes = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, spaces)));
+        EmitWords(text, i, word_bytes ^ (word_bytes << 1 | state.in_word), state, words);
     }
+    state.has_control |= _mm256_movemask_epi8(controls) != 0;
+    return i;
+}
+
+#endif  // STRING_PROCESSING_X86
 
+TokenizerIsa DetectTokenizerIsa() {
+#ifdef STRING_PROCESSING_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return TokenizerIsa::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return TokenizerIsa::SSE2;
+    }
+#endif
+    return TokenizerIsa::SCALAR;
+}
+
+const TokenizerIsa supported_isa = DetectTokenizerIsa();
+TokenizerIsa active_isa = supported_isa;
+
+}  // namespace
+
+TokenizerIsa GetTokenizerIsa() {
+    return active_isa;
+}
+
+void SetTokenizerIsa(TokenizerIsa isa) {
+    active_isa = static_cast<int>(isa) <= static_cast<int>(supported_isa) ? isa : supported_isa;
+}
+
+const char* GetTokenizerIsaName(TokenizerIsa isa) {
+    switch (isa) {
+    case TokenizerIsa::AVX2:
+        return "avx2";
+    case TokenizerIsa::SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+std::vector<std::string_view> SplitIntoWords(std::string_view str) {
+    std::vector<std::string_view> result;
+    SplitIntoWords(str, result);
     return result;
-}
\ No newline at end of file
+}
+
+void SplitIntoWords(std::string_view str, std::vector<std::string_view>& result) {
+    TokenizeWords(str, result);
+}
+
+bool TokenizeWords(std::string_view text, std::vector<std::string_view>& words) {
+    words.clear();
+    TokenizerState state;
+    size_t position = 0;
+#ifdef STRING_PROCESSING_X86
+    switch (active_isa) {
+    case TokenizerIsa::AVX2:
+        position = TokenizeAvx2(text, state, words);
+        break;
+    case TokenizerIsa::SSE2:
+        position = TokenizeSse2(text, state, words);
+        break;
+    default:
+        break;
+    }
+#endif
+    TokenizeScalar(text, position, state, words);
+    if (state.in_word) {
+        words.push_back(text.substr(state.word_begin));
+    }
+    return !state.has_control;
+}
@@ -6,10 +6,33 @@
 
 std::vector<std::string_view> SplitIntoWords(const std::string_view text);
 
+// Replaces the contents of words, reusing their memory
+void SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
+
+enum class TokenizerIsa {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+// The best instruction set the CPU supports unless SetTokenizerIsa picked another
+TokenizerIsa GetTokenizerIsa();
+
+// Falls back to the best supported instruction set if isa is not available
+void SetTokenizerIsa(TokenizerIsa isa);
+
+const char* GetTokenizerIsaName(TokenizerIsa isa);
+
+// Splits the text into words like SplitIntoWords and checks its characters in the same
+// pass, over blocks of 16/32 bytes with SSE2/AVX2 as selected by SetTokenizerIsa. Returns
+// false if the text holds a control character (a byte below ' '), which makes the word
+// holding it invalid; the words are split either way
+bool TokenizeWords(std::string_view text, std::vector<std::string_view>& words);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string, std::less<>> non_empty_strings;
-    for (const auto str : strings) {
+    for (const auto& str : strings) {
         if (!str.empty()) {
             non_empty_strings.insert(std::string(str));
         }
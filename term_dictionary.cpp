@@ -0,0 +1,30 @@
+#include "term_dictionary.h"
+
+int TermDictionary::Find(std::string_view term) const {
+    const auto it = term_to_id_.find(term);
+    return it == term_to_id_.end() ? NO_TERM : it->second;
+}
+
+int TermDictionary::Intern(std::string_view term) {
+    const int term_id = Find(term);
+    if (term_id != NO_TERM) {
+        return term_id;
+    }
+    return InternExternal(term_storage_.Store(term));
+}
+
+int TermDictionary::InternExternal(std::string_view term) {
+    const auto [it, inserted] = term_to_id_.emplace(term, static_cast<int>(id_to_term_.size()));
+    if (inserted) {
+        id_to_term_.push_back(term);
+    }
+    return it->second;
+}
+
+std::string_view TermDictionary::GetTerm(int term_id) const {
+    return id_to_term_[term_id];
+}
+
+size_t TermDictionary::size() const {
+    return id_to_term_.size();
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "text_arena.h"
+
+// Maps every indexed word to a dense term id, so a query word is resolved once
+// with a single hash lookup instead of scanning the whole vocabulary. The dictionary
+// keeps its own copy of every term, views returned by GetTerm live as long as it does.
+class TermDictionary {
+public:
+    static constexpr int NO_TERM = -1;
+
+    // Returns NO_TERM if the word has never been indexed
+    int Find(std::string_view term) const;
+
+    int Intern(std::string_view term);
+
+    // Like Intern without copying, the viewed characters must outlive the dictionary
+    int InternExternal(std::string_view term);
+
+    std::string_view GetTerm(int term_id) const;
+
+    size_t size() const;
+
+private:
+    TextArena term_storage_;
+    std::unordered_map<std::string_view, int> term_to_id_;
+    std::vector<std::string_view> id_to_term_;
+};
@@ -0,0 +1,34 @@
+#include "text_arena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+TextArena::TextArena(size_t chunk_size)
+    : chunk_size_(chunk_size)
+{
+    if (chunk_size_ == 0) {
+        throw std::invalid_argument("Chunk size must be positive");
+    }
+}
+
+std::string_view TextArena::Store(std::string_view text) {
+    if (text.empty()) {
+        return {};
+    }
+    if (current_capacity_ - current_used_ < text.size()) {
+        // a text longer than a chunk gets a chunk of its own
+        current_capacity_ = std::max(chunk_size_, text.size());
+        current_used_ = 0;
+        chunks_.push_back(std::make_unique<char[]>(current_capacity_));
+        capacity_ += current_capacity_;
+    }
+    char* data = chunks_.back().get() + current_used_;
+    std::memcpy(data, text.data(), text.size());
+    current_used_ += text.size();
+    return { data, text.size() };
+}
+
+size_t TextArena::GetCapacity() const {
+    return capacity_;
+}
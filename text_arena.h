@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Chunked storage for strings that are referenced through string_view. Every chunk
+// is one allocation holding many strings, a stored string never moves and lives
+// as long as the arena does.
+class TextArena {
+public:
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+    explicit TextArena(size_t chunk_size = DEFAULT_CHUNK_SIZE);
+
+    TextArena(const TextArena&) = delete;
+    TextArena& operator=(const TextArena&) = delete;
+
+    // chunks are owned through pointers, so moved views stay valid in the new owner
+    TextArena(TextArena&& other) noexcept = default;
+    TextArena& operator=(TextArena&& other) noexcept = default;
+
+    // Copies the text into the arena
+    std::string_view Store(std::string_view text);
+
+    // Bytes allocated for the chunks
+    size_t GetCapacity() const;
+
+private:
+    size_t chunk_size_;
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    size_t current_capacity_ = 0; // of chunks_.back()
+    size_t current_used_ = 0;
+    size_t capacity_ = 0;
+};
@@ -0,0 +1,61 @@
+#pragma once
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Objects reused by the calls made on one thread, typically scratch buffers whose
+// memory should survive from one call to the next. Every thread has its own free
+// list, so Acquire takes no lock. A call nested on the same thread, like a task run
+// by a pool thread while it waits, gets another object instead of the one in use.
+template <typename T>
+class ThreadLocalPool {
+public:
+    // Returns the object to the free list of the thread when destroyed
+    class Lease {
+    public:
+        explicit Lease(std::unique_ptr<T> object)
+            : object_(std::move(object))
+        {
+        }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        ~Lease() {
+            GetFreeObjects().push_back(std::move(object_));
+        }
+
+        T& operator*() const {
+            return *object_;
+        }
+
+        T* operator->() const {
+            return object_.get();
+        }
+
+    private:
+        std::unique_ptr<T> object_;
+    };
+
+    static Lease Acquire();
+
+private:
+    static std::vector<std::unique_ptr<T>>& GetFreeObjects();
+};
+
+template <typename T>
+typename ThreadLocalPool<T>::Lease ThreadLocalPool<T>::Acquire() {
+    auto& free_objects = GetFreeObjects();
+    if (free_objects.empty()) {
+        return Lease(std::make_unique<T>());
+    }
+    auto object = std::move(free_objects.back());
+    free_objects.pop_back();
+    return Lease(std::move(object));
+}
+
+template <typename T>
+std::vector<std::unique_ptr<T>>& ThreadLocalPool<T>::GetFreeObjects() {
+    static thread_local std::vector<std::unique_ptr<T>> free_objects;
+    return free_objects;
+}
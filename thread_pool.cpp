@@ -0,0 +1,145 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace {
+
+constexpr size_t NOT_A_WORKER = static_cast<size_t>(-1);
+
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker_index = NOT_A_WORKER;
+
+std::atomic<size_t> default_thread_count = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    thread_count = std::max<size_t>(thread_count, 1);
+    for (size_t i = 0; i <= thread_count; ++i) {
+        queues_.push_back(std::make_unique<TaskQueue>());
+    }
+    threads_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back([this, i] { Run(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard guard(sleep_mutex_);
+        stopping_ = true;
+    }
+    task_available_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+ThreadPool& ThreadPool::GetDefault() {
+    static ThreadPool pool(default_thread_count != 0 ? default_thread_count.load() : std::thread::hardware_concurrency());
+    return pool;
+}
+
+void ThreadPool::SetDefaultThreadCount(size_t thread_count) {
+    default_thread_count = thread_count;
+}
+
+void ThreadPool::WaitAll(std::vector<std::future<void>>& futures) {
+    for (auto& future : futures) {
+        HelpUntil([&future] { return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+}
+
+size_t ThreadPool::GetThreadCount() const {
+    return threads_.size();
+}
+
+ThreadPool::Statistics ThreadPool::GetStatistics() const {
+    return { queued_task_count_.load(), steal_count_.load(), executed_task_count_.load() };
+}
+
+void ThreadPool::Push(Task task) {
+    TaskQueue& queue = *queues_[GetOwnQueueIndex()];
+    // counted before it is visible, so the counter never drops below the real queue depth
+    queued_task_count_.fetch_add(1);
+    {
+        std::lock_guard guard(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        // pairs with the predicate check of a worker going to sleep, so the wake-up is not lost
+        std::lock_guard guard(sleep_mutex_);
+    }
+    task_available_.notify_one();
+    WakeHelpers();
+}
+
+bool ThreadPool::RunPendingTask() {
+    if (queued_task_count_.load() == 0) {
+        return false;
+    }
+    const size_t own_index = GetOwnQueueIndex();
+    Task task;
+    // own deque from the back, then the others from the front
+    for (size_t attempt = 0; attempt < queues_.size() && !task; ++attempt) {
+        const size_t index = (own_index + attempt) % queues_.size();
+        TaskQueue& queue = *queues_[index];
+        std::lock_guard guard(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (attempt == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            if (index != queues_.size() - 1) {
+                steal_count_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    queued_task_count_.fetch_sub(1);
+    task();
+    executed_task_count_.fetch_add(1, std::memory_order_relaxed);
+    WakeHelpers();
+    return true;
+}
+
+void ThreadPool::WakeHelpers() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_helper_count_.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    {
+        // a helper holds the mutex from counting itself until it waits, so it cannot miss this
+        std::lock_guard guard(sleep_mutex_);
+    }
+    task_finished_.notify_all();
+}
+
+void ThreadPool::Run(size_t worker_index) {
+    current_pool = this;
+    current_worker_index = worker_index;
+    while (true) {
+        if (RunPendingTask()) {
+            continue;
+        }
+        std::unique_lock lock(sleep_mutex_);
+        task_available_.wait(lock, [this] { return stopping_ || queued_task_count_.load() > 0; });
+        if (stopping_ && queued_task_count_.load() == 0) {
+            return;
+        }
+    }
+}
+
+size_t ThreadPool::GetOwnQueueIndex() const {
+    return current_pool == this ? current_worker_index : queues_.size() - 1;
+}
@@ -0,0 +1,192 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Work-stealing executor. Every worker owns a deque: tasks spawned on a worker go
+// to the back of its deque and the worker takes them back LIFO, idle workers steal
+// from the front of the other deques. Tasks submitted from outside the pool go to
+// a separate injection queue. A thread waiting for tasks of the pool (ParallelFor,
+// WaitAll) runs pending tasks meanwhile, so nested parallel calls never need more
+// threads than the pool has. With nothing left to run it yields a few times, then
+// sleeps until a task finishes or a new one is queued.
+class ThreadPool {
+public:
+    struct Statistics {
+        size_t queue_depth = 0;          // tasks waiting to be started
+        uint64_t steal_count = 0;        // tasks taken from another worker's deque
+        uint64_t executed_task_count = 0;
+    };
+
+    explicit ThreadPool(size_t thread_count = std::thread::hardware_concurrency());
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Waits for the queued tasks to finish
+    ~ThreadPool();
+
+    // The pool behind execution::par in SearchServer and ProcessQueries
+    static ThreadPool& GetDefault();
+
+    // Takes effect only if called before the first GetDefault()
+    static void SetDefaultThreadCount(size_t thread_count);
+
+    template <typename Function>
+    std::future<std::invoke_result_t<Function>> Submit(Function function);
+
+    // Calls function(i) for every i in [0, count) and returns when all calls are done.
+    // The first exception thrown by a call is rethrown.
+    template <typename Function>
+    void ParallelFor(size_t count, Function function);
+
+    // Waits for every future, running pending tasks meanwhile, before the first
+    // exception is rethrown, so no task outlives the data it references
+    template <typename Result>
+    std::vector<Result> WaitAll(std::vector<std::future<Result>>& futures);
+
+    void WaitAll(std::vector<std::future<void>>& futures);
+
+    // Returns when the future is ready, running pending tasks meanwhile
+    template <typename Result>
+    void Wait(const std::future<Result>& future);
+
+    size_t GetThreadCount() const;
+
+    Statistics GetStatistics() const;
+
+private:
+    using Task = std::function<void()>;
+
+    // yields of a waiting thread that found nothing to run before it goes to sleep
+    static constexpr size_t HELP_SPIN_COUNT = 64;
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // one queue per worker, the last one takes tasks from outside the pool
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex sleep_mutex_;
+    std::condition_variable task_available_;
+    // threads sleeping in HelpUntil, woken when a task finishes or is queued
+    std::condition_variable task_finished_;
+    std::atomic<size_t> sleeping_helper_count_ = 0;
+    std::atomic<size_t> queued_task_count_ = 0;
+    std::atomic<uint64_t> steal_count_ = 0;
+    std::atomic<uint64_t> executed_task_count_ = 0;
+    bool stopping_ = false;
+
+    void Push(Task task);
+
+    // Runs one queued task if there is any
+    bool RunPendingTask();
+
+    // Wakes the threads sleeping in HelpUntil, if there are any
+    void WakeHelpers();
+
+    template <typename Predicate>
+    void HelpUntil(Predicate is_done);
+
+    void Run(size_t worker_index);
+
+    // Queue of the calling thread, the injection queue for threads outside the pool
+    size_t GetOwnQueueIndex() const;
+};
+
+template <typename Function>
+std::future<std::invoke_result_t<Function>> ThreadPool::Submit(Function function) {
+    // std::function needs a copyable target, packaged_task is move-only
+    auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Function>()>>(std::move(function));
+    auto result = task->get_future();
+    Push([task] { (*task)(); });
+    return result;
+}
+
+template <typename Function>
+void ThreadPool::ParallelFor(size_t count, Function function) {
+    if (count == 0) {
+        return;
+    }
+    // a few chunks per thread leave room for stealing without flooding the queues
+    const size_t chunk_count = std::min(count, GetThreadCount() * 4);
+    const size_t chunk_size = (count + chunk_count - 1) / chunk_count;
+    std::atomic<size_t> remaining = chunk_count;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    const auto run_chunk = [&](size_t chunk) {
+        try {
+            const size_t end = std::min(count, (chunk + 1) * chunk_size);
+            for (size_t i = chunk * chunk_size; i < end; ++i) {
+                function(i);
+            }
+        }
+        catch (...) {
+            std::lock_guard guard(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        remaining.fetch_sub(1, std::memory_order_acq_rel);
+    };
+    for (size_t chunk = 1; chunk < chunk_count; ++chunk) {
+        Push([&run_chunk, chunk] { run_chunk(chunk); });
+    }
+    run_chunk(0);
+    HelpUntil([&remaining] { return remaining.load(std::memory_order_acquire) == 0; });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+template <typename Result>
+std::vector<Result> ThreadPool::WaitAll(std::vector<std::future<Result>>& futures) {
+    for (auto& future : futures) {
+        HelpUntil([&future] { return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+    }
+    std::vector<Result> results;
+    results.reserve(futures.size());
+    for (auto& future : futures) {
+        results.push_back(future.get());
+    }
+    return results;
+}
+
+template <typename Result>
+void ThreadPool::Wait(const std::future<Result>& future) {
+    HelpUntil([&future] { return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+}
+
+template <typename Predicate>
+void ThreadPool::HelpUntil(Predicate is_done) {
+    size_t idle_count = 0;
+    while (!is_done()) {
+        if (RunPendingTask()) {
+            idle_count = 0;
+        }
+        else if (++idle_count <= HELP_SPIN_COUNT) {
+            std::this_thread::yield();
+        }
+        else {
+            // the awaited tasks run on other threads
+            std::unique_lock lock(sleep_mutex_);
+            sleeping_helper_count_.fetch_add(1);
+            // pairs with the fence of WakeHelpers: either it sees this thread or the check below sees its task
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            task_finished_.wait(lock, [&] { return is_done() || queued_task_count_.load() > 0; });
+            sleeping_helper_count_.fetch_sub(1);
+            idle_count = 0;
+        }
+    }
+}
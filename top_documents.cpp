@@ -0,0 +1,62 @@
+#include "top_documents.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
+        if (lhs.rating == rhs.rating) {
+            return lhs.id < rhs.id;
+        }
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+TopDocuments::TopDocuments(size_t capacity, size_t candidate_count)
+    : capacity_(capacity) {
+    heap_.reserve(std::min(capacity, candidate_count));
+}
+
+void TopDocuments::Reset(size_t capacity, size_t candidate_count) {
+    capacity_ = capacity;
+    heap_.clear();
+    heap_.reserve(std::min(capacity, candidate_count));
+}
+
+void TopDocuments::Push(const Document& document) {
+    if (heap_.size() < capacity_) {
+        heap_.push_back(document);
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+    else if (capacity_ > 0 && IsMoreRelevant(document, heap_.front())) {
+        std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        heap_.back() = document;
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+}
+
+void TopDocuments::Merge(const TopDocuments& other) {
+    for (const Document& document : other.heap_) {
+        Push(document);
+    }
+}
+
+bool TopDocuments::IsFull() const {
+    return heap_.size() == capacity_;
+}
+
+const Document& TopDocuments::GetWorst() const {
+    return heap_.front();
+}
+
+std::vector<Document> TopDocuments::Release() {
+    std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    return std::move(heap_);
+}
+
+void TopDocuments::Release(std::vector<Document>& documents) {
+    std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    documents.assign(heap_.begin(), heap_.end());
+    heap_.clear();
+}
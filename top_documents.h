@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+
+#include "document.h"
+
+constexpr double EPSILON = 1e-6;
+
+// Ranking order of FindTopDocuments: relevance, then rating, then id for stable output
+bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+// Keeps the best `capacity` documents seen so far in a heap with the worst one on top
+class TopDocuments {
+public:
+    // Reserves room for no more than candidate_count documents, so a huge capacity costs nothing
+    TopDocuments(size_t capacity, size_t candidate_count);
+
+    // Empties the heap for another query, keeping its memory
+    void Reset(size_t capacity, size_t candidate_count);
+
+    void Push(const Document& document);
+
+    void Merge(const TopDocuments& other);
+
+    bool IsFull() const;
+
+    // The document a newcomer has to beat once the heap is full
+    const Document& GetWorst() const;
+
+    // Best first
+    std::vector<Document> Release();
+
+    // Best first into documents, reusing their memory; the heap is left empty
+    void Release(std::vector<Document>& documents);
+
+private:
+    size_t capacity_;
+    std::vector<Document> heap_;
+};